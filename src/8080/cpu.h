@@ -1,22 +1,110 @@
 #pragma once
+#include <array>
+#include <memory>
+#include <utility>
+#include <vector>
 #include "types.h"
+#include "jit.h"
 
-class Memory;
+// Defer Sign/Zero/Parity/HalfCarry until something reads them. Set to 0 to
+// compute every flag eagerly; both modes produce identical F values.
+#ifndef I8080_LAZY_FLAGS
+#define I8080_LAZY_FLAGS 1
+#endif
 
+// Dispatch opcodes with computed gotos (GCC/Clang labels-as-values) instead
+// of a switch.
+#ifndef I8080_THREADED_DISPATCH
+#define I8080_THREADED_DISPATCH 0
+#endif
+
+// Link in the ROM blocks that invaders-recompile wrote to recompiled.inc.
+// Only the spaceinvaders-aot targets set this.
+#ifndef I8080_AOT
+#define I8080_AOT 0
+#endif
+
+#if defined(__GNUC__)
+#define I8080_INLINE __attribute__((always_inline)) inline
+#else
+#define I8080_INLINE inline
+#endif
+
+// Registers and run state as stored in a save state. Fixed size with no
+// implicit padding, so it can be copied and written out as raw bytes.
+struct CpuState {
+    u64 instructions;
+    int32_t cycles;
+    u16 pc;
+    u16 sp;
+    u8 A, B, C, D, E, H, L, F;
+    u8 halted;
+    u8 interrupt_enable;
+    u8 reserved[6];
+};
+
+static_assert(sizeof(CpuState) == 32, "CpuState layout changed");
+
+// Code that never changes, e.g. the ROM, is run from basic blocks decoded
+// once into opcode/operand records, one block starting at every address
+// below end. Nothing in it depends on the machine running the code, so
+// every Cpu running the same ROM shares one, read-only.
+struct CodeCache {
+    struct Decoded {
+        u8 opcode;
+        u16 operand;
+        u16 next_pc;
+    };
+
+    struct Block {
+        u32 first;          // index of the first instruction in decoded
+        u32 count;
+        int cycles;         // base cycles of the whole block
+        int lead_cycles;    // base cycles before the last instruction
+        bool spins;         // may loop on itself without side effects
+    };
+
+    u16 end = 0;
+    std::vector<Block> blocks;      // the block at each address
+    std::vector<Decoded> decoded;
+
+    static CodeCache build(const u8* code, u16 end);
+};
+
+// Generated by invaders-recompile, see recompiled.inc
+template <typename Bus>
+struct Recompiled;
+
+// Bus accesses resolve at compile time so they can inline into
+// execute_instruction(). Each bus instantiates Cpu in its own source file,
+// see cpu_impl.h.
+template <typename Bus>
 class Cpu 
 {
+    friend struct Recompiled<Bus>;
+
     public:
-    Cpu(Memory& _memory);
+    Cpu(Bus& _bus);
 
     void execute_instruction();
+    void run(int cycle_target);
+    void set_code_cache(std::shared_ptr<const CodeCache> cache);
+    void set_jit(bool enable);
+    bool set_recompiled(bool enable);
+    void set_idle_skip(bool enable);
+    bool same_state(const Cpu& other) const;
+    void save_state(CpuState& state) const;
+    void load_state(const CpuState& state);
     void reset();
     int get_cycles() const;
     void set_cycles(int val);
+    u64 get_instructions() const;
     void interrupt(u16 addr);
 
     private:
-    Memory& memory;
+    Bus& bus;
     int cycles;
+    u64 instructions;
     bool halted;
     bool interrupt_enable;
 
@@ -31,11 +119,68 @@ class Cpu
         Sign        = 0x80
     };
 
+    static constexpr int ALU_FLAGS = 0xD5; // Sign | Zero | HalfCarry | Parity | Carry
+    static constexpr bool LAZY_FLAGS = I8080_LAZY_FLAGS;
+
+    // ALU operation whose result still has to be folded into F
+    enum class FlagOp : u8 {
+        None, Add, Sub, Inr, Dcr, Ana, Logic
+    };
+
     u8 A, B, C, D, E, H, L; // Registers
     u8 F; // Flag register
+    FlagOp flag_op;
+    u8 flag_a, flag_b, flag_res; // operands and result of flag_op
     u16 pc; // Program counter
     u16 sp; // Stack pointer
 
+    // Code below cache_end runs from the blocks of code_cache; code anywhere
+    // else, e.g. in RAM, is always fetched and decoded normally.
+    using Decoded = CodeCache::Decoded;
+    using Block = CodeCache::Block;
+    using Native = void (*)(Cpu* cpu);
+
+    // What a block that spins looked like when last entered, see skip_spin()
+    struct Spin {
+        u8 A, B, C, D, E, H, L, F;
+        u16 sp;
+        bool halted;
+
+        bool operator==(const Spin& other) const {
+            return A == other.A && B == other.B && C == other.C && D == other.D
+                && E == other.E && H == other.H && L == other.L && F == other.F
+                && sp == other.sp && halted == other.halted;
+        }
+    };
+
+    std::shared_ptr<const CodeCache> code_cache;
+    const Block* blocks = nullptr;
+    const Decoded* decoded = nullptr;
+    u16 cache_end = 0;
+    static constexpr u16 NO_BLOCK = 0xFFFF;
+    bool idle_skip = true;
+    u16 spin_block = NO_BLOCK;
+    u64 spin_mark = 0;      // instructions at the next entry if nothing else ran
+    Spin spin = {};
+
+    // Blocks entered JIT_THRESHOLD times are translated to native code, which
+    // runs the simple instructions inline and calls helper<opcode>() for the
+    // rest. Running translated blocks is opt-in through set_jit().
+    static constexpr u32 JIT_THRESHOLD = 8;
+    static constexpr size_t JIT_BUFFER_SIZE = 1 << 20;
+    bool jit = false;
+    bool recompiled = false; // use the blocks from recompiled.inc
+    const Native* recompiled_blocks = nullptr; // per address, or null
+#if I8080_JIT
+    // Per block address, only allocated while the JIT is on
+    struct Translated {
+        u32 entries;        // times entered while still interpreted
+        Native native;      // translated code, or null
+    };
+    std::vector<Translated> translated;
+    std::unique_ptr<CodeBuffer> code;
+#endif
+
     inline u16 get_HL() const {
         return (static_cast<u16>(H) << 8) | L;
     }
@@ -49,7 +194,7 @@ class Cpu
     }
 
     inline u16 get_AF() const {
-        return (static_cast<u16>(A) << 8) | F;
+        return (static_cast<u16>(A) << 8) | get_F();
     }
 
     inline void set_HL(u16 data) {
@@ -70,6 +215,7 @@ class Cpu
     inline void set_AF(u16 data) {
         A = data >> 8;
         F = data & 0xFF;
+        flag_op = FlagOp::None;
     }
 
     friend inline Flags operator|(Flags a, Flags b) {
@@ -83,13 +229,16 @@ class Cpu
     private:
     u8 read_byte(u16 addr) const;
     u16 read_word(u16 addr) const;
+    u16 read_operand(u16 addr, int length) const;
 
     void write_byte(u16 addr, u8 data);
     void write_word(u16 addr, u16 data);
-    u16 read_next_word();
 
     void set_flags(Flags flgs, bool x);
-    bool parity_check(u8 byte);
+    void set_alu_flags(FlagOp op, u8 data, u8 res, int keep, int carry);
+    static u8 half_carry(FlagOp op, u8 a, u8 b, u8 res);
+    u8 get_F() const;
+    bool flag(Flags flg) const;
 
     void push(u16 data);
     u16 pop();
@@ -106,6 +255,24 @@ class Cpu
     void dad(u16 data);
     void jmp(const u16 addr);
     void call(const u16 addr);
+    void rst(const u16 addr);
+
+    I8080_INLINE void execute(u8 opcode, u16 operand);
+    const Block* enter_block(int cycle_target);
+    void skip_spin(u16 index, int cycle_target);
+
+    void run_native(int cycle_target);
+    Native translate(const Block& block);
+    bool translate_native(CodeBuffer& out, u8 opcode, u16 operand);
+    int offset(const void* member) const;
+    u8* reg8(int index);
+
+    using Helper = void (*)(Cpu* cpu, u16 operand);
+    template <size_t OP>
+    static void helper(Cpu* cpu, u16 operand);
+    template <size_t... OPS>
+    static std::array<Helper, 256> helpers(std::index_sequence<OPS...>);
+
     void rlc();
     void rrc();
     void ral();
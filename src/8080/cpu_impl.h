@@ -0,0 +1,1317 @@
+#pragma once
+#include "cpu.h"
+#include "opcodes.h"
+#include <array>
+#include <iostream>
+
+// Member definitions of Cpu, for the source file that owns a bus to
+// instantiate Cpu with it
+
+template <typename Bus>
+Cpu<Bus>::Cpu(Bus& _bus)
+    :
+    bus{_bus}
+{
+    reset();
+    set_flags(Reserved1, 1);
+}
+
+template <typename Bus>
+void Cpu<Bus>::reset()
+{
+    A = 0x00;
+    B = 0x00;
+    C = 0x00;
+    D = 0x00;
+    E = 0x00;
+    H = 0x00;
+    L = 0x00;
+    F = 0x00;
+    flag_op = FlagOp::None;
+    flag_a = 0x00;
+    flag_b = 0x00;
+    flag_res = 0x00;
+    pc = 0x0000;
+    sp = 0x0000;
+
+    halted = false;
+    cycles = 0;
+    instructions = 0;
+    interrupt_enable = false;
+}
+
+template <typename Bus>
+int Cpu<Bus>::get_cycles() const
+{
+    return cycles;
+}
+
+template <typename Bus>
+void Cpu<Bus>::set_cycles(int val)
+{
+    cycles = val;
+}
+
+template <typename Bus>
+u64 Cpu<Bus>::get_instructions() const
+{
+    return instructions;
+}
+
+template <typename Bus>
+void Cpu<Bus>::interrupt(u16 addr)
+{
+    if (!interrupt_enable)
+        return;
+    
+    push(pc);
+    pc = addr;
+    interrupt_enable = false;
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::read_byte(u16 addr) const
+{
+    return bus.read_byte(addr);
+}
+
+template <typename Bus>
+u16 Cpu<Bus>::read_word(u16 addr) const
+{
+    return bus.read_word(addr);
+}
+
+template <typename Bus>
+u16 Cpu<Bus>::read_operand(u16 addr, int length) const
+{
+    if (length == 3)
+        return read_word(addr);
+    if (length == 2)
+        return read_byte(addr);
+    return 0;
+}
+
+template <typename Bus>
+void Cpu<Bus>::write_byte(u16 addr, u8 data)
+{
+    bus.write_byte(addr, data);
+}
+
+template <typename Bus>
+void Cpu<Bus>::write_word(u16 addr, u16 data)
+{
+    bus.write_word(addr, data);
+}
+
+template <typename Bus>
+void Cpu<Bus>::set_flags(Flags flgs, bool x)
+{
+    if (x)
+        F |= flgs;
+    else
+        F &= ~flgs;
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::half_carry(FlagOp op, u8 a, u8 b, u8 res)
+{
+    switch (op)
+    {
+        case FlagOp::Add: return ((a & 0xF) + (b & 0xF)) & HalfCarry;
+        case FlagOp::Sub: return (a & 0xF) >= (b & 0xF) ? HalfCarry : 0;
+        case FlagOp::Inr: return (res & 0x0F) == 0x00 ? HalfCarry : 0;
+        case FlagOp::Dcr: return (res & 0x0F) == 0x0F ? HalfCarry : 0;
+        case FlagOp::Ana: return ((a | b) & 0x08) << 1;
+        default:          return 0;
+    }
+}
+
+// keep selects the bits of F that survive the operation and carry is the new
+// Carry bit. With lazy flags only the operands are recorded; Sign, Zero,
+// Parity and HalfCarry are derived from them when get_F() or flag() asks.
+template <typename Bus>
+void Cpu<Bus>::set_alu_flags(FlagOp op, u8 data, u8 res, int keep, int carry)
+{
+    if (LAZY_FLAGS) {
+        F = (F & (keep | Sign | Zero | Parity | HalfCarry)) | carry;
+        flag_op = op;
+        flag_a = A;
+        flag_b = data;
+        flag_res = res;
+    }
+    else
+        F = (F & keep) | carry | SZP_TABLE[res] | half_carry(op, A, data, res);
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::get_F() const
+{
+    if (!LAZY_FLAGS || flag_op == FlagOp::None)
+        return F;
+
+    return (F & ~(Sign | Zero | Parity | HalfCarry)) | SZP_TABLE[flag_res]
+        | half_carry(flag_op, flag_a, flag_b, flag_res);
+}
+
+template <typename Bus>
+bool Cpu<Bus>::flag(Flags flg) const
+{
+    if (!LAZY_FLAGS || flag_op == FlagOp::None || flg == Carry)
+        return F & flg;
+
+    return SZP_TABLE[flag_res] & flg;
+}
+
+template <typename Bus>
+void Cpu<Bus>::push(u16 data)
+{
+    write_byte(--sp, data >> 8);
+    write_byte(--sp, data & 0xFF);
+}
+
+template <typename Bus>
+u16 Cpu<Bus>::pop()
+{
+    const u8 lo = read_byte(sp++);
+    const u8 hi = read_byte(sp++);
+    return lo | static_cast<u16>(hi) << 8;    
+}
+
+template <typename Bus>
+void Cpu<Bus>::xthl()
+{
+    const u16 temp = get_HL();
+    set_HL(read_word(sp));
+    write_word(sp, temp);
+}
+
+template <typename Bus>
+void Cpu<Bus>::xchg()
+{
+    const u16 temp = get_HL();
+    set_HL(get_DE());
+    set_DE(temp);
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::add(u8 data, u8 cf)
+{
+    const u16 u16res = A + data + cf;
+    const u8 u8res = u16res;
+
+    set_alu_flags(FlagOp::Add, data, u8res, ~ALU_FLAGS, u16res >> 8);
+
+    return u8res;
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::sub(u8 data, u8 cf)
+{
+    const u8 res = A - data - cf;
+
+    set_alu_flags(FlagOp::Sub, data, res, ~ALU_FLAGS, A < data);
+    
+    return res;
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::inr(u8 data)
+{
+    data++;
+    set_alu_flags(FlagOp::Inr, 0, data, ~ALU_FLAGS | Carry, 0);
+
+    return data;
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::dcr(u8 data)
+{
+    data--;
+    set_alu_flags(FlagOp::Dcr, 0, data, ~ALU_FLAGS | Carry, 0);
+
+    return data;
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::ana(u8 data)
+{
+    const u8 res = A & data;
+
+    set_alu_flags(FlagOp::Ana, data, res, ~ALU_FLAGS, 0);
+
+    return res;
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::ora(u8 data)
+{
+    const u8 res = A | data;
+
+    set_alu_flags(FlagOp::Logic, data, res, ~ALU_FLAGS, 0);
+
+    return res;
+}
+
+template <typename Bus>
+u8 Cpu<Bus>::xra(u8 data)
+{
+    const u8 res = A ^ data;
+
+    set_alu_flags(FlagOp::Logic, data, res, ~ALU_FLAGS, 0);
+
+    return res;
+}
+
+template <typename Bus>
+void Cpu<Bus>::daa()
+{
+    F = get_F();
+    flag_op = FlagOp::None;
+
+    if (((A & 0x0F) > 9) || (F & HalfCarry))
+    {
+        A += 0x06;
+        F |= HalfCarry;
+    }
+    else
+        F &= ~HalfCarry;
+
+    if ((A > 0x9F) || (F & Carry))
+    {
+        A += 0x60;
+        F |= Carry;
+    }
+    
+    F = (F & ~(Sign | Zero | Parity)) | SZP_TABLE[A];
+}
+
+template <typename Bus>
+void Cpu<Bus>::dad(u16 data)
+{
+    const u32 u32res = static_cast<u32>(get_HL()) + static_cast<u32>(data);
+    const u16 u16res = static_cast<u16>(u32res);
+    set_flags(Carry, u32res > 0xFFFF);
+    set_HL(u16res);
+}
+
+template <typename Bus>
+void Cpu<Bus>::call(const u16 addr)
+{
+    push(pc);
+    pc = addr;
+}
+
+template <typename Bus>
+void Cpu<Bus>::rst(const u16 addr)
+{
+    push(pc + 2); // same return address as the original call()-based RST
+    pc = addr;
+}
+
+template <typename Bus>
+void Cpu<Bus>::rlc()
+{
+    A = (A << 1) | (A >> 7);
+    set_flags(Carry, A & 0x01);
+}
+
+template <typename Bus>
+void Cpu<Bus>::rrc()
+{
+    set_flags(Carry, A & 0x01);
+    A = (A >> 1) | (A << 7);
+}
+
+template <typename Bus>
+void Cpu<Bus>::ral()
+{
+    u8 a = A;
+    A <<= 1;
+    if (F & Carry) A |= 0x01;
+    set_flags(Carry, a & 0x80);
+}
+
+template <typename Bus>
+void Cpu<Bus>::rar()
+{
+    u8 a = A;
+    A >>= 1;
+    if (F & Carry) A |= 0x80;
+    set_flags(Carry, a & 0x01);
+}
+
+// A null cache runs everything through the interpreter
+template <typename Bus>
+void Cpu<Bus>::set_code_cache(std::shared_ptr<const CodeCache> cache)
+{
+    code_cache = std::move(cache);
+    blocks = code_cache ? code_cache->blocks.data() : nullptr;
+    decoded = code_cache ? code_cache->decoded.data() : nullptr;
+    cache_end = code_cache ? code_cache->end : 0;
+    spin_block = NO_BLOCK;
+    set_jit(jit);
+}
+
+// The translator needs the block cache, so this only takes effect for code
+// below the set_code_cache() limit.
+template <typename Bus>
+void Cpu<Bus>::set_jit(bool enable)
+{
+#if I8080_JIT
+    jit = enable;
+    if (jit && !code)
+        code = std::make_unique<CodeBuffer>(JIT_BUFFER_SIZE);
+    if (code)
+        code->clear();
+    translated.assign(jit ? cache_end : 0, {});
+#else
+    (void)enable;
+#endif
+}
+
+// Skipping the passes of idle loops is on by default, see skip_spin()
+template <typename Bus>
+void Cpu<Bus>::set_idle_skip(bool enable)
+{
+    idle_skip = enable;
+    spin_block = NO_BLOCK;
+}
+
+// Switches to the blocks from recompiled.inc, but only if the code below the
+// set_code_cache() limit is the ROM they were generated from. Returns whether
+// they are in use.
+template <typename Bus>
+bool Cpu<Bus>::set_recompiled(bool enable)
+{
+#if I8080_AOT
+    // Looked up once for every Cpu on this bus
+    static const std::vector<Native> table = [] {
+        std::vector<Native> natives(Recompiled<Bus>::ROM_SIZE);
+        for (u16 addr = 0; addr < natives.size(); addr++)
+            natives[addr] = Recompiled<Bus>::find(addr);
+        return natives;
+    }();
+
+    recompiled = enable && Recompiled<Bus>::matches(*this);
+    recompiled_blocks = recompiled ? table.data() : nullptr;
+#else
+    (void)enable;
+#endif
+    return recompiled;
+}
+
+// Compares everything a program can observe, for checking one execution
+// engine against another
+template <typename Bus>
+bool Cpu<Bus>::same_state(const Cpu& other) const
+{
+    return A == other.A && B == other.B && C == other.C && D == other.D
+        && E == other.E && H == other.H && L == other.L
+        && get_F() == other.get_F() && pc == other.pc && sp == other.sp
+        && cycles == other.cycles && instructions == other.instructions
+        && halted == other.halted && interrupt_enable == other.interrupt_enable;
+}
+
+// Pending lazy flags are folded into F, which is all a program can observe
+template <typename Bus>
+void Cpu<Bus>::save_state(CpuState& state) const
+{
+    state = {};
+    state.instructions = instructions;
+    state.cycles = cycles;
+    state.pc = pc;
+    state.sp = sp;
+    state.A = A;
+    state.B = B;
+    state.C = C;
+    state.D = D;
+    state.E = E;
+    state.H = H;
+    state.L = L;
+    state.F = get_F();
+    state.halted = halted;
+    state.interrupt_enable = interrupt_enable;
+}
+
+// The block cache only covers ROM, so it stays valid
+template <typename Bus>
+void Cpu<Bus>::load_state(const CpuState& state)
+{
+    instructions = state.instructions;
+    cycles = state.cycles;
+    pc = state.pc;
+    sp = state.sp;
+    A = state.A;
+    B = state.B;
+    C = state.C;
+    D = state.D;
+    E = state.E;
+    H = state.H;
+    L = state.L;
+    F = state.F;
+    flag_op = FlagOp::None;
+    halted = state.halted;
+    interrupt_enable = state.interrupt_enable;
+    spin_block = NO_BLOCK;
+}
+
+// Returns the block at pc, or null if it is empty (an instruction straddling
+// cache_end) or the budget check before its last instruction would fail.
+// The whole block is charged up front, so in that case the caller steps
+// through it one instruction at a time instead.
+template <typename Bus>
+const typename Cpu<Bus>::Block* Cpu<Bus>::enter_block(int cycle_target)
+{
+    const Block& block = blocks[pc];
+    if (block.spins && idle_skip)
+        skip_spin(pc, cycle_target);
+
+    if (block.count == 0 || cycles + block.lead_cycles >= cycle_target)
+        return nullptr;
+
+    cycles += block.cycles;
+    instructions += block.count;
+    return &block;
+}
+
+// Nothing but the CPU runs until run() returns, so a block that spins and
+// comes round to the registers it had on its last entry, with nothing else
+// run in between, is in a loop whose passes are all the same: it writes
+// nothing, so the memory it reads cannot change. That is a wait for the
+// next interrupt, or a HLT. All but the last one or two passes before
+// cycle_target are skipped by charging their cycles and instructions at
+// once, so the interrupt comes at exactly the same point as before.
+template <typename Bus>
+void Cpu<Bus>::skip_spin(u16 index, int cycle_target)
+{
+    const Block& block = blocks[index];
+    const Spin now = {A, B, C, D, E, H, L, get_F(), sp, halted};
+
+    if (index == spin_block && instructions == spin_mark && now == spin) {
+        const int passes = (cycle_target - cycles) / block.cycles - 1;
+        if (passes > 0) {
+            cycles += passes * block.cycles;
+            instructions += static_cast<u64>(passes) * block.count;
+        }
+    }
+
+    spin_block = index;
+    spin_mark = instructions + block.count;
+    spin = now;
+}
+
+template <typename Bus>
+void Cpu<Bus>::execute_instruction()
+{
+    //i8080_debug_output();
+    run(cycles + 1);
+}
+
+// Executes one instruction whose immediate bytes are in operand, with pc
+// already past it. Everything that runs code inlines this, so wherever the
+// opcode is a constant the switch folds down to a single body.
+template <typename Bus>
+I8080_INLINE void Cpu<Bus>::execute(u8 opcode, u16 operand)
+{
+#define OPCODE(op) case op
+#define NEXT return
+
+    switch (opcode)
+    {
+       // NOP
+       OPCODE(0x00): NEXT;       OPCODE(0x08): NEXT;
+       OPCODE(0x10): NEXT;       OPCODE(0x18): NEXT;
+       OPCODE(0x20): NEXT;       OPCODE(0x28): NEXT;
+       OPCODE(0x30): NEXT;       OPCODE(0x38): NEXT;
+
+       // MOV
+       OPCODE(0x40): NEXT;
+       OPCODE(0x50): D = B; NEXT;
+       OPCODE(0x60): H = B; NEXT;
+       OPCODE(0x70): write_byte(get_HL(), B); NEXT;
+       OPCODE(0x41): B = C; NEXT;
+       OPCODE(0x51): D = C; NEXT;
+       OPCODE(0x61): H = C; NEXT;
+       OPCODE(0x71): write_byte(get_HL(), C); NEXT;
+       OPCODE(0x42): B = D; NEXT;
+       OPCODE(0x52): NEXT;
+       OPCODE(0x62): H = D; NEXT;
+       OPCODE(0x72): write_byte(get_HL(), D); NEXT;
+       OPCODE(0x43): B = E; NEXT;
+       OPCODE(0x53): D = E; NEXT;
+       OPCODE(0x63): H = E; NEXT;
+       OPCODE(0x73): write_byte(get_HL(), E); NEXT;
+       OPCODE(0x44): B = H; NEXT;
+       OPCODE(0x54): D = H; NEXT;
+       OPCODE(0x64): NEXT;
+       OPCODE(0x74): write_byte(get_HL(), H); NEXT;
+       OPCODE(0x45): B = L; NEXT;
+       OPCODE(0x55): D = L; NEXT;
+       OPCODE(0x65): H = L; NEXT;
+       OPCODE(0x75): write_byte(get_HL(), L); NEXT;
+       OPCODE(0x46): B = read_byte(get_HL()); NEXT;
+       OPCODE(0x56): D = read_byte(get_HL()); NEXT;
+       OPCODE(0x66): H = read_byte(get_HL()); NEXT;
+       OPCODE(0x47): B = A; NEXT;
+       OPCODE(0x57): D = A; NEXT;
+       OPCODE(0x67): H = A; NEXT;
+       OPCODE(0x77): write_byte(get_HL(), A); NEXT;
+       OPCODE(0x48): C = B; NEXT;
+       OPCODE(0x58): E = B; NEXT;
+       OPCODE(0x68): L = B; NEXT;
+       OPCODE(0x78): A = B; NEXT;
+       OPCODE(0x49): NEXT;
+       OPCODE(0x59): E = C; NEXT;
+       OPCODE(0x69): L = C; NEXT;
+       OPCODE(0x79): A = C; NEXT;
+       OPCODE(0x4A): C = D; NEXT;
+       OPCODE(0x5A): E = D; NEXT;
+       OPCODE(0x6A): L = D; NEXT;
+       OPCODE(0x7A): A = D; NEXT;
+       OPCODE(0x4B): C = E; NEXT;
+       OPCODE(0x5B): NEXT;
+       OPCODE(0x6B): L = E; NEXT;
+       OPCODE(0x7B): A = E; NEXT;
+       OPCODE(0x4C): C = H; NEXT;
+       OPCODE(0x5C): E = H; NEXT;
+       OPCODE(0x6C): L = H; NEXT;
+       OPCODE(0x7C): A = H; NEXT;
+       OPCODE(0x4D): C = L; NEXT;
+       OPCODE(0x5D): E = L; NEXT;
+       OPCODE(0x6D): NEXT;
+       OPCODE(0x7D): A = L; NEXT;
+       OPCODE(0x4E): C = read_byte(get_HL()); NEXT;
+       OPCODE(0x5E): E = read_byte(get_HL()); NEXT;
+       OPCODE(0x6E): L = read_byte(get_HL()); NEXT;
+       OPCODE(0x7E): A = read_byte(get_HL()); NEXT;
+       OPCODE(0x4F): C = A; NEXT;
+       OPCODE(0x5F): E = A; NEXT;
+       OPCODE(0x6F): L = A; NEXT;
+       OPCODE(0x7F): NEXT;
+
+       // MVI
+       OPCODE(0x06): B = operand; NEXT;
+       OPCODE(0x16): D = operand; NEXT;
+       OPCODE(0x26): H = operand; NEXT;
+       OPCODE(0x36): write_byte(get_HL(), operand); NEXT;
+       OPCODE(0x0E): C = operand; NEXT;
+       OPCODE(0x1E): E = operand; NEXT;
+       OPCODE(0x2E): L = operand; NEXT;
+       OPCODE(0x3E): A = operand; NEXT;
+
+       OPCODE(0x3A): A = read_byte(operand); NEXT;   // LDA
+       OPCODE(0x32): write_byte(operand, A); NEXT;   // STA
+
+       // LDAX
+       OPCODE(0x0A): A = read_byte(get_BC()); NEXT;
+       OPCODE(0x1A): A = read_byte(get_DE()); NEXT;
+
+       // STAX
+       OPCODE(0x02): write_byte(get_BC(), A); NEXT;
+       OPCODE(0x12): write_byte(get_DE(), A); NEXT;
+
+       OPCODE(0x2A): set_HL(read_word(operand)); NEXT;  // LHLD 
+       OPCODE(0x22): write_word(operand, get_HL()); NEXT;  // SHLD
+
+       // LXI
+       OPCODE(0x01): set_BC(operand); NEXT;
+       OPCODE(0x11): set_DE(operand); NEXT;
+       OPCODE(0x21): set_HL(operand); NEXT;
+       OPCODE(0x31): sp = operand; NEXT;
+
+       // PUSH
+       OPCODE(0xC5): push(get_BC()); NEXT;
+       OPCODE(0xD5): push(get_DE()); NEXT;
+       OPCODE(0xE5): push(get_HL()); NEXT;
+       OPCODE(0xF5): push(get_AF()); NEXT;
+
+       // POP
+       OPCODE(0xC1): set_BC(pop()); NEXT;
+       OPCODE(0xD1): set_DE(pop()); NEXT;
+       OPCODE(0xE1): set_HL(pop()); NEXT;
+       OPCODE(0xF1): set_AF(pop());  NEXT;
+
+       OPCODE(0xE3): xthl(); NEXT; // XTHL
+       OPCODE(0xF9): sp = get_HL(); NEXT; // SPHL
+       OPCODE(0xE9): pc = get_HL(); NEXT; // PCHL
+       OPCODE(0xEB): xchg(); NEXT; // XCHG
+
+       // ADD
+       OPCODE(0x80): A = add(B, 0); NEXT;
+       OPCODE(0x81): A = add(C, 0); NEXT;
+       OPCODE(0x82): A = add(D, 0); NEXT;
+       OPCODE(0x83): A = add(E, 0); NEXT;
+       OPCODE(0x84): A = add(H, 0); NEXT;
+       OPCODE(0x85): A = add(L, 0); NEXT;
+       OPCODE(0x86): A = add(read_byte(get_HL()), 0); NEXT;
+       OPCODE(0x87): A = add(A, 0); NEXT;
+
+       // SUB
+       OPCODE(0x90): A = sub(B, 0); NEXT;
+       OPCODE(0x91): A = sub(C, 0); NEXT;
+       OPCODE(0x92): A = sub(D, 0); NEXT;
+       OPCODE(0x93): A = sub(E, 0); NEXT;
+       OPCODE(0x94): A = sub(H, 0); NEXT;
+       OPCODE(0x95): A = sub(L, 0); NEXT;
+       OPCODE(0x96): A = sub(read_byte(get_HL()), 0); NEXT;
+       OPCODE(0x97): A = sub(A, 0); NEXT;
+       
+       // INR
+       OPCODE(0x04): B = inr(B); NEXT;
+       OPCODE(0x14): D = inr(D); NEXT;
+       OPCODE(0x24): H = inr(H); NEXT;
+       OPCODE(0x34): write_byte(get_HL(), inr(read_byte(get_HL()))); NEXT;
+       OPCODE(0x0C): C = inr(C); NEXT;
+       OPCODE(0x1C): E = inr(E); NEXT;
+       OPCODE(0x2C): L = inr(L); NEXT;
+       OPCODE(0x3C): A = inr(A); NEXT;
+
+       // DCR
+       OPCODE(0x05): B = dcr(B); NEXT;
+       OPCODE(0x15): D = dcr(D); NEXT;
+       OPCODE(0x25): H = dcr(H); NEXT;
+       OPCODE(0x35): write_byte(get_HL(), dcr(read_byte(get_HL()))); NEXT;
+       OPCODE(0x0D): C = dcr(C); NEXT;
+       OPCODE(0x1D): E = dcr(E); NEXT;
+       OPCODE(0x2D): L = dcr(L); NEXT;
+       OPCODE(0x3D): A = dcr(A); NEXT;
+
+       // CMP
+       OPCODE(0xB8): sub(B, 0); NEXT; 
+       OPCODE(0xB9): sub(C, 0); NEXT; 
+       OPCODE(0xBA): sub(D, 0); NEXT; 
+       OPCODE(0xBB): sub(E, 0); NEXT; 
+       OPCODE(0xBC): sub(H, 0); NEXT; 
+       OPCODE(0xBD): sub(L, 0); NEXT; 
+       OPCODE(0xBE): sub(read_byte(get_HL()), 0); NEXT; 
+       OPCODE(0xBF): sub(A, 0); NEXT; 
+
+       // ANA
+       OPCODE(0xA0): A = ana(B); NEXT;
+       OPCODE(0xA1): A = ana(C); NEXT;
+       OPCODE(0xA2): A = ana(D); NEXT;
+       OPCODE(0xA3): A = ana(E); NEXT;
+       OPCODE(0xA4): A = ana(H); NEXT;
+       OPCODE(0xA5): A = ana(L); NEXT;
+       OPCODE(0xA6): A = ana(read_byte(get_HL())); NEXT;
+       OPCODE(0xA7): A = ana(A); NEXT;
+
+       // ORA
+       OPCODE(0xB0): A = ora(B); NEXT;
+       OPCODE(0xB1): A = ora(C); NEXT;
+       OPCODE(0xB2): A = ora(D); NEXT;
+       OPCODE(0xB3): A = ora(E); NEXT;
+       OPCODE(0xB4): A = ora(H); NEXT;
+       OPCODE(0xB5): A = ora(L); NEXT;
+       OPCODE(0xB6): A = ora(read_byte(get_HL())); NEXT;
+       OPCODE(0xB7): A = ora(A); NEXT;
+
+       // XRA
+       OPCODE(0xA8): A = xra(B); NEXT;
+       OPCODE(0xA9): A = xra(C); NEXT;
+       OPCODE(0xAA): A = xra(D); NEXT;
+       OPCODE(0xAB): A = xra(E); NEXT;
+       OPCODE(0xAC): A = xra(H); NEXT;
+       OPCODE(0xAD): A = xra(L); NEXT;
+       OPCODE(0xAE): A = xra(read_byte(get_HL())); NEXT;
+       OPCODE(0xAF): A = xra(A); NEXT;
+
+       OPCODE(0xC6): A = add(operand, 0); NEXT; // ADI
+       OPCODE(0xD6): A = sub(operand, 0); NEXT; // SUI
+       OPCODE(0xE6): A = ana(operand); NEXT;    // ANI
+       OPCODE(0xF6): A = ora(operand); NEXT;    // ORI
+       OPCODE(0xEE): A = xra(operand); NEXT;    // XRI
+       OPCODE(0xFE): sub(operand, 0); NEXT;     // CPI
+       OPCODE(0x27): daa(); NEXT;                       // DAA
+
+       // ADC
+       OPCODE(0x88): A = add(B, F & Carry); NEXT;
+       OPCODE(0x89): A = add(C, F & Carry); NEXT;
+       OPCODE(0x8A): A = add(D, F & Carry); NEXT;
+       OPCODE(0x8B): A = add(E, F & Carry); NEXT;
+       OPCODE(0x8C): A = add(H, F & Carry); NEXT;
+       OPCODE(0x8D): A = add(L, F & Carry); NEXT;
+       OPCODE(0x8E): A = add(read_byte(get_HL()), F & Carry); NEXT;
+       OPCODE(0x8F): A = add(A, F & Carry); NEXT;
+
+       OPCODE(0xCE): A = add(operand, F & Carry); NEXT; // ACI
+
+       // SBB
+       OPCODE(0x98): A = sub(B, F & Carry); NEXT;
+       OPCODE(0x99): A = sub(C, F & Carry); NEXT;
+       OPCODE(0x9A): A = sub(D, F & Carry); NEXT;
+       OPCODE(0x9B): A = sub(E, F & Carry); NEXT;
+       OPCODE(0x9C): A = sub(H, F & Carry); NEXT;
+       OPCODE(0x9D): A = sub(L, F & Carry); NEXT;
+       OPCODE(0x9E): A = sub(read_byte(get_HL()), F & Carry); NEXT;
+       OPCODE(0x9F): A = sub(A, F & Carry); NEXT;
+
+       OPCODE(0xDE): A = sub(operand, F & Carry); NEXT; // SBI
+
+       // DAD
+       OPCODE(0x09): dad(get_BC()); NEXT;
+       OPCODE(0x19): dad(get_DE()); NEXT;
+       OPCODE(0x29): dad(get_HL()); NEXT;
+       OPCODE(0x39): dad(sp); NEXT;
+
+       // INX
+       OPCODE(0x03): set_BC(get_BC() + 1); NEXT;
+       OPCODE(0x13): set_DE(get_DE() + 1); NEXT;
+       OPCODE(0x23): set_HL(get_HL() + 1); NEXT;
+       OPCODE(0x33): sp++; NEXT;
+
+       // DCX
+       OPCODE(0x0B): set_BC(get_BC() - 1); NEXT;
+       OPCODE(0x1B): set_DE(get_DE() - 1); NEXT;
+       OPCODE(0x2B): set_HL(get_HL() - 1); NEXT;
+       OPCODE(0x3B): sp--; NEXT;    
+      
+       // JMP
+       OPCODE(0xC3): pc = operand; NEXT;
+       OPCODE(0xCB): pc = operand; NEXT;
+
+       // CALL
+       OPCODE(0xCD): call(operand); NEXT;
+       OPCODE(0xDD): call(operand); NEXT;
+       OPCODE(0xED): call(operand); NEXT;
+       OPCODE(0xFD): call(operand); NEXT;
+
+       // RET
+       OPCODE(0xC9): pc = pop(); NEXT;
+       OPCODE(0xD9): pc = pop(); NEXT;
+       
+       OPCODE(0xC2): if (!flag(Zero)) { pc = operand; } NEXT;     // JNZ
+       OPCODE(0xCA): if (flag(Zero)) { pc = operand; } NEXT;       // JZ
+       OPCODE(0xD2): if (!flag(Carry)) { pc = operand; } NEXT;   // JNC
+       OPCODE(0xDA): if (flag(Carry)) { pc = operand; } NEXT;      // JC
+       OPCODE(0xE2): if (!flag(Parity)) { pc = operand; } NEXT;  // JPO
+       OPCODE(0xEA): if (flag(Parity)) { pc = operand; } NEXT;     // JPE
+       OPCODE(0xF2): if (!flag(Sign)) { pc = operand; } NEXT;    // JP
+       OPCODE(0xFA): if (flag(Sign)) { pc = operand; } NEXT;       // JM
+       OPCODE(0xC4): if (!flag(Zero)) { cycles += 6; call(operand); } NEXT;    // CNZ
+       OPCODE(0xCC): if (flag(Zero)) { cycles += 6; call(operand); } NEXT;       // CZ
+       OPCODE(0xD4): if (!flag(Carry)) { cycles += 6; call(operand); } NEXT;   // CNC
+       OPCODE(0xDC): if (flag(Carry)) { cycles += 6; call(operand); } NEXT;      // CC
+       OPCODE(0xE4): if (!flag(Parity)) { cycles += 6; call(operand); } NEXT;  // CPO
+       OPCODE(0xEC): if (flag(Parity)) { cycles += 6; call(operand); } NEXT;     // CPE
+       OPCODE(0xF4): if (!flag(Sign)) { cycles += 6; call(operand); } NEXT;    // CP
+       OPCODE(0xFC): if (flag(Sign)) { cycles += 6; call(operand); } NEXT;       // CM
+       OPCODE(0xC0): if (!flag(Zero)) { cycles += 6; pc = pop(); } NEXT;   // RNZ
+       OPCODE(0xC8): if (flag(Zero)) { cycles += 6; pc = pop(); } NEXT;      // RZ
+       OPCODE(0xD0): if (!flag(Carry)) { cycles += 6; pc = pop(); } NEXT;  // RNC
+       OPCODE(0xD8): if (flag(Carry)) { cycles += 6; pc = pop(); } NEXT;     // RC
+       OPCODE(0xE0): if (!flag(Parity)) { cycles += 6; pc = pop(); } NEXT; // RPO
+       OPCODE(0xE8): if (flag(Parity)) { cycles += 6; pc = pop(); } NEXT;    // RPE
+       OPCODE(0xF0): if (!flag(Sign)) { cycles += 6; pc = pop(); } NEXT;   // RP
+       OPCODE(0xF8): if (flag(Sign)) { cycles += 6; pc = pop(); } NEXT;      // RM
+       OPCODE(0x07): rlc(); NEXT;    // RLC
+       OPCODE(0x0F): rrc(); NEXT;    // RRC
+       OPCODE(0x17): ral(); NEXT;    // RAL
+       OPCODE(0x1F): rar(); NEXT;    // RAR
+       OPCODE(0xF3): interrupt_enable = false; NEXT;    // DI
+       OPCODE(0xFB): interrupt_enable = true; NEXT;   // EI
+       OPCODE(0x3F): F ^= Carry; NEXT;            // CMC
+       OPCODE(0x37): set_flags(Carry, 1); NEXT;   // STC
+       OPCODE(0x2F): A ^= 0xFF; NEXT;             // CMA
+       OPCODE(0x76): halted = 1; pc--; NEXT;      // HLT
+
+       // RST
+       OPCODE(0xC7): rst(0x00); NEXT;
+       OPCODE(0xCF): rst(0x08); NEXT;
+       OPCODE(0xD7): rst(0x10); NEXT;
+       OPCODE(0xDF): rst(0x18); NEXT;
+       OPCODE(0xE7): rst(0x20); NEXT;
+       OPCODE(0xEF): rst(0x28); NEXT;
+       OPCODE(0xF7): rst(0x30); NEXT;
+       OPCODE(0xFF): rst(0x38); NEXT;
+
+       OPCODE(0xDB): A = bus.read_port(operand); NEXT;  // IN
+       OPCODE(0xD3): bus.write_port(operand, A); NEXT;  // OUT
+    }
+
+#undef OPCODE
+#undef NEXT
+}
+
+// Runs until cycles reaches cycle_target, dispatching opcodes either with a
+// switch inside a loop or, with I8080_THREADED_DISPATCH, a computed goto at
+// the end of every handler.
+template <typename Bus>
+void Cpu<Bus>::run(int cycle_target)
+{
+    if (jit || recompiled) {
+        run_native(cycle_target);
+        return;
+    }
+
+    u8 opcode;
+    u16 operand;
+    const Decoded* op = nullptr;
+    const Decoded* op_end = nullptr;
+
+// Both leave the next opcode in opcode, its immediate bytes in operand and pc
+// pointing past it. FETCH() enters the block at pc once the current one is
+// done, or decodes a single instruction from memory when there is no block.
+#define FETCH_DECODED()                                         \
+    opcode = op->opcode;                                        \
+    operand = op->operand;                                      \
+    pc = op->next_pc;                                           \
+    op++
+
+#define FETCH()                                                 \
+    if (op != op_end) {                                         \
+        FETCH_DECODED();                                        \
+    }                                                           \
+    else {                                                      \
+        if (cycles >= cycle_target)                             \
+            return;                                             \
+        const Block* block;                                     \
+        if (pc < cache_end && (block = enter_block(cycle_target))) { \
+            op = decoded + block->first;                        \
+            op_end = op + block->count;                         \
+            FETCH_DECODED();                                    \
+        }                                                       \
+        else {                                                  \
+            opcode = read_byte(pc);                             \
+            operand = read_operand(pc + 1, LENGTH_TABLE[opcode]); \
+            pc += LENGTH_TABLE[opcode];                         \
+            cycles += CYCLES_TABLE[opcode];                     \
+            instructions++;                                     \
+        }                                                       \
+    }
+
+#if I8080_THREADED_DISPATCH
+#define NEXT                                                    \
+    if (op != op_end) {                                         \
+        FETCH_DECODED();                                        \
+        goto *DISPATCH_TABLE[opcode];                           \
+    }                                                           \
+    goto fetch
+#define HANDLER(op) op_##op: execute(op, operand); NEXT;
+#define HANDLERS(hi)                                                         \
+    HANDLER(0x##hi##0) HANDLER(0x##hi##1) HANDLER(0x##hi##2) HANDLER(0x##hi##3) \
+    HANDLER(0x##hi##4) HANDLER(0x##hi##5) HANDLER(0x##hi##6) HANDLER(0x##hi##7) \
+    HANDLER(0x##hi##8) HANDLER(0x##hi##9) HANDLER(0x##hi##A) HANDLER(0x##hi##B) \
+    HANDLER(0x##hi##C) HANDLER(0x##hi##D) HANDLER(0x##hi##E) HANDLER(0x##hi##F)
+#define LABELS(hi)                                                           \
+    &&op_0x##hi##0, &&op_0x##hi##1, &&op_0x##hi##2, &&op_0x##hi##3,         \
+    &&op_0x##hi##4, &&op_0x##hi##5, &&op_0x##hi##6, &&op_0x##hi##7,         \
+    &&op_0x##hi##8, &&op_0x##hi##9, &&op_0x##hi##A, &&op_0x##hi##B,         \
+    &&op_0x##hi##C, &&op_0x##hi##D, &&op_0x##hi##E, &&op_0x##hi##F
+
+    static const void* const DISPATCH_TABLE[256] = {
+        LABELS(0), LABELS(1), LABELS(2), LABELS(3),
+        LABELS(4), LABELS(5), LABELS(6), LABELS(7),
+        LABELS(8), LABELS(9), LABELS(A), LABELS(B),
+        LABELS(C), LABELS(D), LABELS(E), LABELS(F)
+    };
+
+fetch:
+    FETCH();
+    goto *DISPATCH_TABLE[opcode];
+
+    HANDLERS(0) HANDLERS(1) HANDLERS(2) HANDLERS(3)
+    HANDLERS(4) HANDLERS(5) HANDLERS(6) HANDLERS(7)
+    HANDLERS(8) HANDLERS(9) HANDLERS(A) HANDLERS(B)
+    HANDLERS(C) HANDLERS(D) HANDLERS(E) HANDLERS(F)
+
+#undef NEXT
+#undef HANDLER
+#undef HANDLERS
+#undef LABELS
+#else
+    for (;;)
+    {
+        FETCH();
+        execute(opcode, operand);
+    }
+#endif
+
+#undef FETCH_DECODED
+#undef FETCH
+}
+
+
+#if I8080_AOT
+#include "recompiled.inc"
+#endif
+
+// run() with set_jit() or set_recompiled(): translated and recompiled blocks
+// run natively, everything else goes through execute() one instruction at a
+// time. Blocks are charged up front exactly as in run(), so cycle counts and
+// interrupt points match.
+template <typename Bus>
+void Cpu<Bus>::run_native(int cycle_target)
+{
+    while (cycles < cycle_target)
+    {
+        const u16 start = pc;
+        const Block* block = pc < cache_end ? enter_block(cycle_target) : nullptr;
+
+        if (!block) {
+            const u8 opcode = read_byte(pc);
+            const u16 operand = read_operand(pc + 1, LENGTH_TABLE[opcode]);
+            pc += LENGTH_TABLE[opcode];
+            cycles += CYCLES_TABLE[opcode];
+            instructions++;
+            execute(opcode, operand);
+            continue;
+        }
+
+        Native native = recompiled ? recompiled_blocks[start] : nullptr;
+#if I8080_JIT
+        if (jit && !native) {
+            Translated& t = translated[start];
+            if (!t.native && ++t.entries == JIT_THRESHOLD)
+                t.native = translate(*block);
+            native = t.native;
+        }
+#endif
+
+        if (native) {
+            native(this);
+            continue;
+        }
+
+        const Decoded* op = decoded + block->first;
+        const Decoded* op_end = op + block->count;
+        for (; op != op_end; op++)
+        {
+            pc = op->next_pc;
+            execute(op->opcode, op->operand);
+        }
+    }
+}
+
+#if I8080_JIT
+template <typename Bus>
+template <size_t OP>
+void Cpu<Bus>::helper(Cpu* cpu, u16 operand)
+{
+    cpu->execute(OP, operand);
+}
+
+template <typename Bus>
+template <size_t... OPS>
+std::array<typename Cpu<Bus>::Helper, 256> Cpu<Bus>::helpers(std::index_sequence<OPS...>)
+{
+    return {{ &Cpu::helper<OPS>... }};
+}
+
+template <typename Bus>
+int Cpu<Bus>::offset(const void* member) const
+{
+    return static_cast<const u8*>(member) - reinterpret_cast<const u8*>(this);
+}
+
+// Register operand in the 8080 encoding order B C D E H L M A; null for M
+template <typename Bus>
+u8* Cpu<Bus>::reg8(int index)
+{
+    u8* const regs[8] = { &B, &C, &D, &E, &H, &L, nullptr, &A };
+    return regs[index & 0x07];
+}
+
+// pc is stored as the block's exit address before the last instruction, which
+// is the only one that can read it; a taken jump then overwrites it.
+template <typename Bus>
+typename Cpu<Bus>::Native Cpu<Bus>::translate(const Block& block)
+{
+    static const std::array<Helper, 256> HELPERS = helpers(std::make_index_sequence<256>());
+
+    if (!code->begin())
+        return nullptr;
+
+    code->prologue();
+
+    for (u32 i = 0; i < block.count; i++)
+    {
+        const Decoded& op = decoded[block.first + i];
+
+        if (i == block.count - 1)
+            code->store_imm16(offset(&pc), op.next_pc);
+
+        if (!translate_native(*code, op.opcode, op.operand))
+            code->call(reinterpret_cast<const void*>(HELPERS[op.opcode]), op.operand);
+    }
+
+    code->epilogue();
+    return reinterpret_cast<Native>(const_cast<void*>(code->end()));
+}
+
+// Emits opcode inline if it only touches registers and flags, otherwise
+// returns false so that translate() calls its helper instead. ALU results are
+// recorded exactly as set_alu_flags() does in lazy mode, with Carry taken from
+// the host carry flag; with eager flags ALU ops always go through a helper.
+template <typename Bus>
+bool Cpu<Bus>::translate_native(CodeBuffer& out, u8 opcode, u16 operand)
+{
+    using Alu = CodeBuffer::Alu;
+
+    const int a = offset(&A);
+    const int f = offset(&F);
+    u8* const dst = reg8(opcode >> 3);
+    u8* const src = reg8(opcode);
+
+    // MOV r, r
+    if (opcode >= 0x40 && opcode < 0x80 && dst && src) {
+        if (dst != src) {
+            out.load8(CodeBuffer::AL, offset(src));
+            out.store8(offset(dst), CodeBuffer::AL);
+        }
+        return true;
+    }
+
+    // ADD ADC SUB CMP ANA XRA ORA with a register or an immediate. SBB and SBI
+    // compute Carry without the borrow, which the host cannot reproduce.
+    const bool immediate = (opcode & 0xC7) == 0xC6;
+    const int alu_op = (opcode >> 3) & 0x07;
+    if (LAZY_FLAGS && alu_op != 3 && ((opcode >= 0x80 && opcode < 0xC0 && src) || immediate)) {
+        static constexpr Alu HOST_OP[8] = {
+            CodeBuffer::Add, CodeBuffer::Adc, CodeBuffer::Sub, CodeBuffer::Sbb,
+            CodeBuffer::And, CodeBuffer::Xor, CodeBuffer::Or, CodeBuffer::Sub
+        };
+        static constexpr FlagOp FLAG_OP[8] = {
+            FlagOp::Add, FlagOp::Add, FlagOp::Sub, FlagOp::Sub,
+            FlagOp::Ana, FlagOp::Logic, FlagOp::Logic, FlagOp::Sub
+        };
+        const bool arithmetic = alu_op < 4 || alu_op == 7;
+
+        if (immediate)
+            out.mov_imm8(CodeBuffer::CL, operand);
+        else
+            out.load8(CodeBuffer::CL, offset(src));
+
+        out.load8(CodeBuffer::AL, a);
+        out.store8(offset(&flag_a), CodeBuffer::AL);
+        out.store8(offset(&flag_b), CodeBuffer::CL);
+        if (HOST_OP[alu_op] == CodeBuffer::Adc) {
+            out.load8_zx(CodeBuffer::DL, f);
+            out.shr1(CodeBuffer::DL);
+        }
+        out.alu(HOST_OP[alu_op], CodeBuffer::AL, CodeBuffer::CL);
+        if (arithmetic)
+            out.setc(CodeBuffer::DL);
+        out.store8(offset(&flag_res), CodeBuffer::AL);
+        if (alu_op != 7)
+            out.store8(a, CodeBuffer::AL);
+        out.alu_mem_imm8(CodeBuffer::And, f, static_cast<u8>(~Carry));
+        if (arithmetic)
+            out.alu_mem(CodeBuffer::Or, f, CodeBuffer::DL);
+        out.store_imm8(offset(&flag_op), static_cast<u8>(FLAG_OP[alu_op]));
+        return true;
+    }
+
+    // INR r, DCR r: F itself is left as it is
+    if (LAZY_FLAGS && opcode < 0x40 && (opcode & 0x06) == 0x04 && dst) {
+        out.load8(CodeBuffer::AL, a);
+        out.store8(offset(&flag_a), CodeBuffer::AL);
+        out.store_imm8(offset(&flag_b), 0);
+        out.alu_mem_imm8(opcode & 0x01 ? CodeBuffer::Sub : CodeBuffer::Add, offset(dst), 1);
+        out.load8(CodeBuffer::AL, offset(dst));
+        out.store8(offset(&flag_res), CodeBuffer::AL);
+        out.store_imm8(offset(&flag_op), static_cast<u8>(opcode & 0x01 ? FlagOp::Dcr : FlagOp::Inr));
+        return true;
+    }
+
+    switch (opcode)
+    {
+        case 0x00: case 0x08: case 0x10: case 0x18:     // NOP
+        case 0x20: case 0x28: case 0x30: case 0x38:
+            return true;
+
+        case 0x06: case 0x0E: case 0x16: case 0x1E:     // MVI
+        case 0x26: case 0x2E: case 0x3E:
+            out.store_imm8(offset(dst), operand);
+            return true;
+
+        case 0x01: case 0x11: case 0x21:                // LXI
+            out.store_imm8(offset(reg8(opcode >> 3)), operand >> 8);
+            out.store_imm8(offset(reg8((opcode >> 3) + 1)), operand & 0xFF);
+            return true;
+        case 0x31:
+            out.store_imm16(offset(&sp), operand);
+            return true;
+
+        case 0x03: case 0x13: case 0x23:                // INX
+            out.alu_mem_imm8(CodeBuffer::Add, offset(reg8((opcode >> 3) + 1)), 1);
+            out.alu_mem_imm8(CodeBuffer::Adc, offset(reg8(opcode >> 3)), 0);
+            return true;
+        case 0x33:
+            out.inc_mem16(offset(&sp));
+            return true;
+
+        case 0x0B: case 0x1B: case 0x2B:                // DCX
+            out.alu_mem_imm8(CodeBuffer::Sub, offset(reg8(opcode >> 3)), 1);
+            out.alu_mem_imm8(CodeBuffer::Sbb, offset(reg8((opcode >> 3) - 1)), 0);
+            return true;
+        case 0x3B:
+            out.dec_mem16(offset(&sp));
+            return true;
+
+        case 0xEB:                                      // XCHG
+            out.load8(CodeBuffer::AL, offset(&D));
+            out.load8(CodeBuffer::CL, offset(&H));
+            out.store8(offset(&D), CodeBuffer::CL);
+            out.store8(offset(&H), CodeBuffer::AL);
+            out.load8(CodeBuffer::AL, offset(&E));
+            out.load8(CodeBuffer::CL, offset(&L));
+            out.store8(offset(&E), CodeBuffer::CL);
+            out.store8(offset(&L), CodeBuffer::AL);
+            return true;
+
+        case 0xF9:                                      // SPHL
+            out.load8(CodeBuffer::AL, offset(&L));
+            out.store8(offset(&sp), CodeBuffer::AL);
+            out.load8(CodeBuffer::AL, offset(&H));
+            out.store8(offset(&sp) + 1, CodeBuffer::AL);
+            return true;
+
+        case 0x2F:                                      // CMA
+            out.not_mem8(a);
+            return true;
+        case 0x37:                                      // STC
+            out.alu_mem_imm8(CodeBuffer::Or, f, Carry);
+            return true;
+        case 0x3F:                                      // CMC
+            out.alu_mem_imm8(CodeBuffer::Xor, f, Carry);
+            return true;
+
+        case 0xF3:                                      // DI
+        case 0xFB:                                      // EI
+            out.store_imm8(offset(&interrupt_enable), opcode == 0xFB);
+            return true;
+
+        case 0xC3: case 0xCB:                           // JMP
+            out.store_imm16(offset(&pc), operand);
+            return true;
+
+        case 0xD2: case 0xDA: {                         // JNC, JC
+            out.test_mem8(f, Carry);
+            u8* const skip = out.jump_if_zero(opcode == 0xDA);
+            out.store_imm16(offset(&pc), operand);
+            out.land(skip);
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+#endif
+
+
+static const char* DISASSEMBLE_TABLE[] = {
+    "nop", "lxi b,#", "stax b", "inx b", "inr b", "dcr b", "mvi b,#", "rlc",
+    "ill", "dad b", "ldax b", "dcx b", "inr c", "dcr c", "mvi c,#", "rrc",
+    "ill", "lxi d,#", "stax d", "inx d", "inr d", "dcr d", "mvi d,#", "ral",
+    "ill", "dad d", "ldax d", "dcx d", "inr e", "dcr e", "mvi e,#", "rar",
+    "ill", "lxi h,#", "shld", "inx h", "inr h", "dcr h", "mvi h,#", "daa",
+    "ill", "dad h", "lhld", "dcx h", "inr l", "dcr l", "mvi l,#", "cma",
+    "ill", "lxi sp,#","sta $", "inx sp", "inr M", "dcr M", "mvi M,#", "stc",
+    "ill", "dad sp", "lda $", "dcx sp", "inr a", "dcr a", "mvi a,#", "cmc",
+    "mov b,b", "mov b,c", "mov b,d", "mov b,e", "mov b,h", "mov b,l",
+    "mov b,M", "mov b,a", "mov c,b", "mov c,c", "mov c,d", "mov c,e",
+    "mov c,h", "mov c,l", "mov c,M", "mov c,a", "mov d,b", "mov d,c",
+    "mov d,d", "mov d,e", "mov d,h", "mov d,l", "mov d,M", "mov d,a",
+    "mov e,b", "mov e,c", "mov e,d", "mov e,e", "mov e,h", "mov e,l",
+    "mov e,M", "mov e,a", "mov h,b", "mov h,c", "mov h,d", "mov h,e",
+    "mov h,h", "mov h,l", "mov h,M", "mov h,a", "mov l,b", "mov l,c",
+    "mov l,d", "mov l,e", "mov l,h", "mov l,l", "mov l,M", "mov l,a",
+    "mov M,b", "mov M,c", "mov M,d", "mov M,e", "mov M,h", "mov M,l", "hlt",
+    "mov M,a", "mov a,b", "mov a,c", "mov a,d", "mov a,e", "mov a,h",
+    "mov a,l", "mov a,M", "mov a,a", "add b", "add c", "add d", "add e",
+    "add h", "add l", "add M", "add a", "adc b", "adc c", "adc d", "adc e",
+    "adc h", "adc l", "adc M", "adc a", "sub b", "sub c", "sub d", "sub e",
+    "sub h", "sub l", "sub M", "sub a", "sbb b", "sbb c", "sbb d", "sbb e",
+    "sbb h", "sbb l", "sbb M", "sbb a", "ana b", "ana c", "ana d", "ana e",
+    "ana h", "ana l", "ana M", "ana a", "xra b", "xra c", "xra d", "xra e",
+    "xra h", "xra l", "xra M", "xra a", "ora b", "ora c", "ora d", "ora e",
+    "ora h", "ora l", "ora M", "ora a", "cmp b", "cmp c", "cmp d", "cmp e",
+    "cmp h", "cmp l", "cmp M", "cmp a", "rnz", "pop b", "jnz $", "jmp $",
+    "cnz $", "push b", "adi #", "rst 0", "rz", "ret", "jz $", "ill", "cz $",
+    "call $", "aci #", "rst 1", "rnc", "pop d", "jnc $", "out p", "cnc $",
+    "push d", "sui #", "rst 2", "rc", "ill", "jc $", "in p", "cc $", "ill",
+    "sbi #", "rst 3", "rpo", "pop h", "jpo $", "xthl", "cpo $", "push h",
+    "ani #", "rst 4", "rpe", "pchl", "jpe $", "xchg", "cpe $", "ill", "xri #",
+    "rst 5", "rp", "pop psw", "jp $", "di", "cp $", "push psw","ori #",
+    "rst 6", "rm", "sphl", "jm $", "ei", "cm $", "ill", "cpi #", "rst 7"
+};
+
+// outputs a debug trace of the emulator state to the standard output,
+// including registers and flags
+template <typename Bus>
+void Cpu<Bus>::i8080_debug_output() {
+    char flags[] = "......";
+    const u8 f = get_F();
+
+    if (f & Zero) flags[0] = 'z';
+    if (f & Sign) flags[1] = 's';
+    if (f & Parity) flags[2] = 'p';
+    if (f & HalfCarry) flags[3] = 'a';
+    if (f & Carry) flags[4] = 'c';
+
+    // registers + flags
+    printf("af\tbc\tde\thl\tpc\tsp\tflags\tcycles\n");
+    printf("%04X\t%04X\t%04X\t%04X\t%04X\t%04X\t%s\t%i\n",
+           get_AF(), get_BC(), get_DE(), get_HL(), pc,
+           sp, flags, cycles);
+
+    // current address in memory
+    printf("%04X: ", pc);
+
+    // current opcode + next two
+    printf("%02X %02X %02X", read_byte(pc), read_byte(pc+1),
+           read_byte(pc + 2));
+
+    // disassembly of the current opcode
+    printf(" - %s", DISASSEMBLE_TABLE[read_byte(pc)]);
+
+    printf("\n================================");
+    printf("==============================\n");
+}
+
+/*
+void Cpu::run_testrom() {
+    pc = 0x100; // the test roms all start at 0x100
+    write_byte(5, 0xC9); // inject RET at 0x5 to handle "CALL 5", needed
+                           // for the test roms
+
+    printf("*******************\n");
+
+    while (true) {
+        const u16 cur_pc = pc;
+
+        if (read_byte(pc) == 0x76) { // RET
+            printf("HLT at %04X\n", pc);
+        }
+
+        if (pc == 5) {
+            // prints characters stored in memory at (DE)
+            // until character '$' (0x24 in ASCII) is found
+            A = 0XFF;
+            if (C == 9) {
+                u16 i = get_DE();
+                do {
+                    printf("%c", read_byte(i));
+                    i += 1;
+                } while (read_byte(i) != 0x24);
+            }
+            // prints a single character stored in register E
+            if (C == 2) {
+                printf("%c", E);
+            }
+        }
+
+        // uncomment following line to have a debug output of machine state
+        // warning: will output multiple GB of data for the whole test suite
+        //i8080_debug_output();
+        execute_instruction();
+        
+        if (pc == 0) {
+            printf("\nJumped to 0x0000 from 0x%04X\n\n", cur_pc);
+            break;
+        }
+    }
+}
+*/
@@ -0,0 +1,223 @@
+#include "jit.h"
+
+#if I8080_JIT
+#include <sys/mman.h>
+
+CodeBuffer::CodeBuffer(size_t _capacity)
+{
+    void* memory = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+        base = static_cast<u8*>(memory);
+        capacity = _capacity;
+    }
+}
+
+CodeBuffer::~CodeBuffer()
+{
+    if (base)
+        munmap(base, capacity);
+}
+
+// Opens a new function. The buffer is never writable and executable at the
+// same time, so this flips it back to writable until end().
+bool CodeBuffer::begin()
+{
+    if (!base || size >= capacity)
+        return false;
+
+    mprotect(base, capacity, PROT_READ | PROT_WRITE);
+    start = size;
+    return true;
+}
+
+// Returns the entry point of the function, or null if it ran out of space,
+// in which case it is dropped and every later begin() fails.
+const void* CodeBuffer::end()
+{
+    const void* entry = base + start;
+    if (size > capacity) {
+        size = capacity;
+        entry = nullptr;
+    }
+
+    mprotect(base, capacity, PROT_READ | PROT_EXEC);
+    return entry;
+}
+
+void CodeBuffer::clear()
+{
+    size = 0;
+    start = 0;
+}
+
+void CodeBuffer::emit(u8 byte)
+{
+    if (size < capacity)
+        base[size] = byte;
+    size++;
+}
+
+void CodeBuffer::emit16(u16 data)
+{
+    emit(data & 0xFF);
+    emit(data >> 8);
+}
+
+void CodeBuffer::emit32(u32 data)
+{
+    emit16(data & 0xFFFF);
+    emit16(data >> 16);
+}
+
+void CodeBuffer::emit64(u64 data)
+{
+    emit32(data & 0xFFFFFFFF);
+    emit32(data >> 32);
+}
+
+// [rbx + disp]
+void CodeBuffer::modrm(int reg, int disp)
+{
+    if (disp >= -128 && disp <= 127) {
+        emit(0x43 | reg << 3);
+        emit(disp);
+    }
+    else {
+        emit(0x83 | reg << 3);
+        emit32(disp);
+    }
+}
+
+void CodeBuffer::prologue()
+{
+    emit(0x53);                         // push rbx
+    emit(0x48); emit(0x89); emit(0xFB); // mov rbx, rdi
+}
+
+void CodeBuffer::epilogue()
+{
+    emit(0x5B);                         // pop rbx
+    emit(0xC3);                         // ret
+}
+
+// function(cpu, arg). The pushed rbx keeps the stack 16-byte aligned.
+void CodeBuffer::call(const void* function, u16 arg)
+{
+    emit(0x48); emit(0x89); emit(0xDF); // mov rdi, rbx
+    emit(0xBE); emit32(arg);            // mov esi, arg
+    emit(0x48); emit(0xB8);             // mov rax, function
+    emit64(reinterpret_cast<u64>(function));
+    emit(0xFF); emit(0xD0);             // call rax
+}
+
+void CodeBuffer::load8(Reg dst, int disp)
+{
+    emit(0x8A);
+    modrm(dst, disp);
+}
+
+void CodeBuffer::load8_zx(Reg dst, int disp)
+{
+    emit(0x0F); emit(0xB6);             // movzx r32, byte
+    modrm(dst, disp);
+}
+
+void CodeBuffer::store8(int disp, Reg src)
+{
+    emit(0x88);
+    modrm(src, disp);
+}
+
+void CodeBuffer::store_imm8(int disp, u8 imm)
+{
+    emit(0xC6);
+    modrm(0, disp);
+    emit(imm);
+}
+
+void CodeBuffer::store_imm16(int disp, u16 imm)
+{
+    emit(0x66); emit(0xC7);
+    modrm(0, disp);
+    emit16(imm);
+}
+
+void CodeBuffer::mov_imm8(Reg dst, u8 imm)
+{
+    emit(0xB0 + dst);
+    emit(imm);
+}
+
+void CodeBuffer::alu(Alu op, Reg dst, Reg src)
+{
+    emit(op << 3);
+    emit(0xC0 | src << 3 | dst);
+}
+
+void CodeBuffer::alu_mem(Alu op, int disp, Reg src)
+{
+    emit(op << 3);
+    modrm(src, disp);
+}
+
+void CodeBuffer::alu_mem_imm8(Alu op, int disp, u8 imm)
+{
+    emit(0x80);
+    modrm(op, disp);
+    emit(imm);
+}
+
+void CodeBuffer::inc_mem16(int disp)
+{
+    emit(0x66); emit(0xFF);
+    modrm(0, disp);
+}
+
+void CodeBuffer::dec_mem16(int disp)
+{
+    emit(0x66); emit(0xFF);
+    modrm(1, disp);
+}
+
+void CodeBuffer::not_mem8(int disp)
+{
+    emit(0xF6);
+    modrm(2, disp);
+}
+
+void CodeBuffer::test_mem8(int disp, u8 imm)
+{
+    emit(0xF6);
+    modrm(0, disp);
+    emit(imm);
+}
+
+// shr r32, 1: moves bit 0 into the host carry
+void CodeBuffer::shr1(Reg reg)
+{
+    emit(0xD1);
+    emit(0xE8 | reg);
+}
+
+void CodeBuffer::setc(Reg dst)
+{
+    emit(0x0F); emit(0x92);
+    emit(0xC0 | dst);
+}
+
+// Short forward jz/jnz, resolved by land() once the code it skips is emitted
+u8* CodeBuffer::jump_if_zero(bool zero)
+{
+    emit(zero ? 0x74 : 0x75);
+    emit(0x00);
+    return size <= capacity ? base + size - 1 : nullptr;
+}
+
+void CodeBuffer::land(u8* jump)
+{
+    if (jump && size <= capacity)
+        *jump = base + size - (jump + 1);
+}
+
+#endif
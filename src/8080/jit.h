@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include "types.h"
+
+// Translate hot ROM blocks to x86-64 machine code. Needs nothing beyond
+// mmap/mprotect, so it is on wherever that is available; elsewhere
+// Cpu::set_jit() is a no-op and every block stays interpreted.
+#ifndef I8080_JIT
+#if defined(__x86_64__) && defined(__linux__)
+#define I8080_JIT 1
+#else
+#define I8080_JIT 0
+#endif
+#endif
+
+// Executable memory for translated blocks, plus the few x86-64 encodings the
+// translator needs. A translated block is a function taking the Cpu in rdi,
+// which it keeps in rbx; every memory operand is a displacement from rbx.
+class CodeBuffer
+{
+    public:
+    enum Reg {
+        AL = 0,
+        CL = 1,
+        DL = 2
+    };
+
+    // ModRM reg field of the 0x80 group, and the base opcode / 8 of the
+    // register forms
+    enum Alu {
+        Add = 0,
+        Or  = 1,
+        Adc = 2,
+        Sbb = 3,
+        And = 4,
+        Sub = 5,
+        Xor = 6,
+        Cmp = 7
+    };
+
+    explicit CodeBuffer(size_t capacity);
+    ~CodeBuffer();
+    CodeBuffer(const CodeBuffer&) = delete;
+    CodeBuffer& operator=(const CodeBuffer&) = delete;
+
+    bool begin();
+    const void* end();
+    void clear();
+
+    void prologue();
+    void epilogue();
+    void call(const void* function, u16 arg);
+
+    void load8(Reg dst, int disp);
+    void load8_zx(Reg dst, int disp);
+    void store8(int disp, Reg src);
+    void store_imm8(int disp, u8 imm);
+    void store_imm16(int disp, u16 imm);
+    void mov_imm8(Reg dst, u8 imm);
+
+    void alu(Alu op, Reg dst, Reg src);
+    void alu_mem(Alu op, int disp, Reg src);
+    void alu_mem_imm8(Alu op, int disp, u8 imm);
+    void inc_mem16(int disp);
+    void dec_mem16(int disp);
+    void not_mem8(int disp);
+    void test_mem8(int disp, u8 imm);
+    void shr1(Reg reg);
+    void setc(Reg dst);
+
+    u8* jump_if_zero(bool zero);
+    void land(u8* jump);
+
+    private:
+    void emit(u8 byte);
+    void emit16(u16 data);
+    void emit32(u32 data);
+    void emit64(u64 data);
+    void modrm(int reg, int disp);
+
+    u8* base = nullptr;
+    size_t capacity = 0;
+    size_t start = 0;   // entry of the function being emitted
+    size_t size = 0;
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include "types.h"
+
+// Opcode properties shared by the interpreter, the block cache, the batch
+// core and invaders-recompile, which has to split the ROM into exactly the
+// blocks CodeCache::build() would.
+
+// Base cycle count of every opcode. Conditional calls and returns add 6 more
+// when taken.
+static constexpr u8 CYCLES_TABLE[256] = {
+//   0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
+     4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4,  // 0
+     4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4,  // 1
+     4, 10, 16,  5,  5,  5,  7,  4,  4, 10, 16,  5,  5,  5,  7,  4,  // 2
+     4, 10, 13,  5, 10, 10, 10,  4,  4, 10, 13,  5,  5,  5,  7,  4,  // 3
+     5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,  // 4
+     5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,  // 5
+     5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,  // 6
+     7,  7,  5,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7,  5,  // 7
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 8
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 9
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // A
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // B
+     5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10, 10, 11, 17,  7, 11,  // C
+     5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10, 10, 11, 17,  7, 11,  // D
+     5, 10, 10, 18, 11, 11,  7, 11,  5,  5, 10,  5, 11, 17,  7, 11,  // E
+     5, 10, 10,  4, 11, 11,  7, 11,  5,  5, 10,  4, 11, 17,  7, 11,  // F
+};
+
+// Instruction length in bytes, including the opcode
+static constexpr u8 LENGTH_TABLE[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,  // 0
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,  // 1
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,  // 2
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,  // 3
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 4
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 5
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 6
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 7
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 8
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 9
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // A
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // B
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1,  // C
+    1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,  // D
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,  // E
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,  // F
+};
+
+// Jumps, calls, returns, RST, PCHL and HLT end a basic block
+static constexpr bool ends_block(u8 opcode)
+{
+    if (opcode == 0x76 || opcode == 0xE9)
+        return true;
+
+    if (opcode < 0xC0)
+        return false;
+
+    switch (opcode & 0x07)
+    {
+        case 0x00: case 0x02: case 0x04: case 0x07:
+            return true;
+        case 0x01:
+            return opcode == 0xC9 || opcode == 0xD9;
+        case 0x03:
+            return opcode == 0xC3 || opcode == 0xCB;
+        case 0x05:
+            return opcode == 0xCD || opcode == 0xDD || opcode == 0xED || opcode == 0xFD;
+        default:
+            return false;
+    }
+}
+
+// Blocks are also cut after this many instructions
+static constexpr u32 MAX_BLOCK_LENGTH = 32;
+
+// Whether opcode only changes registers, flags and the halted state: no
+// memory writes, no stack, no ports and no change to interrupts. Besides
+// these, a loop can only read memory.
+static constexpr bool only_registers(u8 opcode)
+{
+    switch (opcode)
+    {
+        case 0x02: case 0x12: case 0x22: case 0x32: // STAX, SHLD, STA
+        case 0x34: case 0x35: case 0x36:            // INR M, DCR M, MVI M
+            return false;
+        case 0xC3: case 0xCB:                       // JMP
+        case 0xEB:                                  // XCHG
+            return true;
+        default:
+            break;
+    }
+
+    if (opcode >= 0x70 && opcode < 0x78)            // MOV M,r but HLT
+        return opcode == 0x76;
+
+    // Jcc and the ALU immediates are the only others from 0xC0 up
+    return opcode < 0xC0 || (opcode & 0x07) == 0x02 || (opcode & 0x07) == 0x06;
+}
+
+// Sign, Zero and Parity flags for every 8-bit result
+static constexpr std::array<u8, 256> SZP_TABLE = [] {
+    std::array<u8, 256> table = {};
+    for (int i = 0; i < 256; i++)
+    {
+        int bits = 0;
+        for (int b = 0; b < 8; b++)
+            bits += (i >> b) & 0x01;
+
+        table[i] = (i & 0x80) | (i == 0 ? 0x40 : 0) | (bits % 2 == 0 ? 0x04 : 0);
+    }
+    return table;
+}();
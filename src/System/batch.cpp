@@ -0,0 +1,753 @@
+#include <algorithm>
+#include "batch.h"
+#include "../8080/cpu_impl.h"
+#include "../8080/opcodes.h"
+
+// AVX2 is picked at run time, like in screen.cpp
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define BATCH_AVX2 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define BATCH_AVX2 0
+#endif
+
+static_assert(Batch::LANES == 8, "one AVX2 vector of 32-bit values per row");
+
+template class Cpu<Batch::Lane>;
+
+// Whether the lockstep path runs opcode; the rest go to the scalar Cpu
+static constexpr bool lockstep(u8 opcode, u16 operand)
+{
+    switch (opcode)
+    {
+        case 0x76: // HLT
+            return false;
+        case 0xDB: // IN
+            return operand >= 1 && operand <= 3;
+        default:   // everything else but RST
+            return opcode < 0xC0 || (opcode & 0x07) != 0x07;
+    }
+}
+
+#if BATCH_AVX2
+using Vec = __m256i;
+using Rows = u32[Batch::FIELD_COUNT][Batch::LANES];
+
+// SZP_TABLE widened for 32-bit gathers
+static constexpr std::array<u32, 256> SZP_WIDE = [] {
+    std::array<u32, 256> table = {};
+    for (int i = 0; i < 256; i++)
+        table[i] = SZP_TABLE[i];
+    return table;
+}();
+
+AVX2_TARGET static inline Vec splat(int value)
+{
+    return _mm256_set1_epi32(value);
+}
+
+AVX2_TARGET static inline Vec get(const Rows& rows, int field)
+{
+    return _mm256_load_si256(reinterpret_cast<const Vec*>(rows[field]));
+}
+
+// Stores value into the lanes selected by mask only
+AVX2_TARGET static inline void put(Rows& rows, int field, Vec value, Vec mask)
+{
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(rows[field]), mask, value);
+}
+
+AVX2_TARGET static inline Vec low_byte(Vec value)
+{
+    return _mm256_and_si256(value, splat(0xFF));
+}
+
+AVX2_TARGET static inline Vec low_word(Vec value)
+{
+    return _mm256_and_si256(value, splat(0xFFFF));
+}
+
+AVX2_TARGET static inline int lanes_of(Vec mask)
+{
+    return _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+}
+
+// BC, DE, HL or SP, numbered as in the opcodes
+AVX2_TARGET static inline Vec get_pair(const Rows& rows, int rp)
+{
+    if (rp == 3)
+        return get(rows, Batch::SP);
+
+    return _mm256_or_si256(_mm256_slli_epi32(get(rows, 2 * rp), 8), get(rows, 2 * rp + 1));
+}
+
+AVX2_TARGET static inline void put_pair(Rows& rows, int rp, Vec value, Vec mask)
+{
+    if (rp == 3) {
+        put(rows, Batch::SP, value, mask);
+        return;
+    }
+
+    put(rows, 2 * rp, _mm256_srli_epi32(value, 8), mask);
+    put(rows, 2 * rp + 1, low_byte(value), mask);
+}
+
+AVX2_TARGET static inline Vec szp(Vec result)
+{
+    return _mm256_i32gather_epi32(reinterpret_cast<const int*>(SZP_WIDE.data()), result, 4);
+}
+
+// Every lane's byte at its own address. Both sources are gathered and the
+// region picks one, so lanes never branch apart.
+AVX2_TARGET static Vec read8(const u8* rom, const u8* ram, Vec addr)
+{
+    const Vec offset = _mm256_and_si256(addr, splat(0x1FFF));
+    const Vec region = _mm256_and_si256(_mm256_srli_epi32(addr, 13), splat(0x03));
+    const Vec lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    const Vec from_rom = _mm256_i32gather_epi32(reinterpret_cast<const int*>(rom), offset, 1);
+    const Vec from_ram = _mm256_i32gather_epi32(reinterpret_cast<const int*>(ram),
+                                                _mm256_add_epi32(_mm256_slli_epi32(offset, 3), lane), 1);
+
+    Vec data = _mm256_blendv_epi8(from_ram, from_rom, _mm256_cmpeq_epi32(region, _mm256_setzero_si256()));
+    data = _mm256_blendv_epi8(data, splat(0xFF), _mm256_cmpeq_epi32(region, splat(2)));
+    return low_byte(data);
+}
+
+// AVX2 has no scatter, so stores go out one lane at a time
+AVX2_TARGET static void write8(u8* ram, int lanes, Vec addr, Vec data)
+{
+    alignas(32) u32 addrs[Batch::LANES];
+    alignas(32) u32 values[Batch::LANES];
+    _mm256_store_si256(reinterpret_cast<Vec*>(addrs), addr);
+    _mm256_store_si256(reinterpret_cast<Vec*>(values), data);
+
+    for (; lanes; lanes &= lanes - 1)
+    {
+        const int lane = __builtin_ctz(lanes);
+        if (addrs[lane] & 0x2000)
+            ram[(addrs[lane] & 0x1FFF) * Batch::LANES + lane] = values[lane];
+    }
+}
+
+AVX2_TARGET static void push16(Rows& rows, u8* ram, Vec mask, Vec value)
+{
+    const Vec sp = get(rows, Batch::SP);
+    const Vec high = low_word(_mm256_sub_epi32(sp, splat(1)));
+    const Vec low = low_word(_mm256_sub_epi32(sp, splat(2)));
+
+    write8(ram, lanes_of(mask), high, _mm256_srli_epi32(value, 8));
+    write8(ram, lanes_of(mask), low, low_byte(value));
+    put(rows, Batch::SP, low, mask);
+}
+
+AVX2_TARGET static Vec pop16(Rows& rows, const u8* rom, const u8* ram, Vec mask)
+{
+    const Vec sp = get(rows, Batch::SP);
+    const Vec low = read8(rom, ram, sp);
+    const Vec high = read8(rom, ram, low_word(_mm256_add_epi32(sp, splat(1))));
+
+    put(rows, Batch::SP, low_word(_mm256_add_epi32(sp, splat(2))), mask);
+    return _mm256_or_si256(low, _mm256_slli_epi32(high, 8));
+}
+
+// Lanes whose flags pass the condition of a Jcc, Ccc or Rcc opcode
+AVX2_TARGET static Vec condition(Vec f, u8 opcode)
+{
+    static constexpr u8 FLAG[4] = {0x40, 0x01, 0x04, 0x80}; // Zero, Carry, Parity, Sign
+
+    const Vec bit = splat(FLAG[(opcode >> 4) & 0x03]);
+    const Vec set = _mm256_cmpeq_epi32(_mm256_and_si256(f, bit), bit);
+    return opcode & 0x08 ? set : _mm256_xor_si256(set, splat(-1));
+}
+
+// ADD ADC SUB SBB ANA XRA ORA CMP, numbered as in the opcodes, with every
+// flag exactly as Cpu computes it
+AVX2_TARGET static void alu(Rows& rows, int op, Vec data, Vec mask)
+{
+    const Vec a = get(rows, Batch::A);
+    const Vec f = get(rows, Batch::F);
+    const Vec nibble = splat(0x0F);
+    const Vec carry_in = op == 1 || op == 3 ? _mm256_and_si256(f, splat(0x01)) : _mm256_setzero_si256();
+
+    Vec result;
+    Vec carry = _mm256_setzero_si256();
+    Vec half = _mm256_setzero_si256();
+
+    switch (op)
+    {
+        case 0: case 1: {
+            const Vec sum = _mm256_add_epi32(_mm256_add_epi32(a, data), carry_in);
+            result = low_byte(sum);
+            carry = _mm256_srli_epi32(sum, 8);
+            half = _mm256_and_si256(_mm256_add_epi32(_mm256_and_si256(a, nibble), _mm256_and_si256(data, nibble)),
+                                    splat(0x10));
+            break;
+        }
+        case 2: case 3: case 7:
+            result = low_byte(_mm256_sub_epi32(_mm256_sub_epi32(a, data), carry_in));
+            carry = _mm256_and_si256(_mm256_cmpgt_epi32(data, a), splat(0x01));
+            half = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_and_si256(data, nibble), _mm256_and_si256(a, nibble)),
+                                       splat(0x10));
+            break;
+        case 4:
+            result = _mm256_and_si256(a, data);
+            half = _mm256_slli_epi32(_mm256_and_si256(_mm256_or_si256(a, data), splat(0x08)), 1);
+            break;
+        case 5:
+            result = _mm256_xor_si256(a, data);
+            break;
+        default:
+            result = _mm256_or_si256(a, data);
+            break;
+    }
+
+    const Vec kept = _mm256_and_si256(f, splat(~0xD5));
+    put(rows, Batch::F, _mm256_or_si256(_mm256_or_si256(kept, carry), _mm256_or_si256(szp(result), half)), mask);
+    if (op != 7)
+        put(rows, Batch::A, result, mask);
+}
+
+AVX2_TARGET static Vec inr_dcr(Rows& rows, Vec value, bool decrement, Vec mask)
+{
+    const Vec result = low_byte(decrement ? _mm256_sub_epi32(value, splat(1)) : _mm256_add_epi32(value, splat(1)));
+    const Vec low = _mm256_and_si256(result, splat(0x0F));
+    const Vec half = _mm256_and_si256(_mm256_cmpeq_epi32(low, splat(decrement ? 0x0F : 0x00)), splat(0x10));
+
+    const Vec kept = _mm256_and_si256(get(rows, Batch::F), splat(~0xD5 | 0x01));
+    put(rows, Batch::F, _mm256_or_si256(kept, _mm256_or_si256(szp(result), half)), mask);
+    return result;
+}
+
+AVX2_TARGET static void daa(Rows& rows, Vec mask)
+{
+    Vec a = get(rows, Batch::A);
+    Vec f = get(rows, Batch::F);
+    const Vec half = splat(0x10);
+    const Vec one = splat(0x01);
+
+    const Vec low = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_and_si256(a, splat(0x0F)), splat(9)),
+                                    _mm256_cmpeq_epi32(_mm256_and_si256(f, half), half));
+    a = low_byte(_mm256_add_epi32(a, _mm256_and_si256(low, splat(0x06))));
+    f = _mm256_or_si256(_mm256_andnot_si256(half, f), _mm256_and_si256(low, half));
+
+    const Vec high = _mm256_or_si256(_mm256_cmpgt_epi32(a, splat(0x9F)),
+                                     _mm256_cmpeq_epi32(_mm256_and_si256(f, one), one));
+    a = low_byte(_mm256_add_epi32(a, _mm256_and_si256(high, splat(0x60))));
+    f = _mm256_or_si256(f, _mm256_and_si256(high, one));
+
+    put(rows, Batch::A, a, mask);
+    put(rows, Batch::F, _mm256_or_si256(_mm256_and_si256(f, splat(~0xC4)), szp(a)), mask);
+}
+
+// RLC RRC RAL RAR CMA STC CMC
+AVX2_TARGET static void rotate(Rows& rows, u8 opcode, Vec mask)
+{
+    const Vec a = get(rows, Batch::A);
+    const Vec f = get(rows, Batch::F);
+    const Vec one = splat(0x01);
+    const Vec carry_in = _mm256_and_si256(f, one);
+
+    Vec result = a;
+    Vec carry = carry_in;
+
+    switch (opcode)
+    {
+        case 0x07:
+            result = low_byte(_mm256_or_si256(_mm256_slli_epi32(a, 1), _mm256_srli_epi32(a, 7)));
+            carry = _mm256_and_si256(result, one);
+            break;
+        case 0x0F:
+            result = low_byte(_mm256_or_si256(_mm256_srli_epi32(a, 1), _mm256_slli_epi32(a, 7)));
+            carry = _mm256_and_si256(a, one);
+            break;
+        case 0x17:
+            result = low_byte(_mm256_or_si256(_mm256_slli_epi32(a, 1), carry_in));
+            carry = _mm256_srli_epi32(a, 7);
+            break;
+        case 0x1F:
+            result = _mm256_or_si256(_mm256_srli_epi32(a, 1), _mm256_slli_epi32(carry_in, 7));
+            carry = _mm256_and_si256(a, one);
+            break;
+        case 0x2F:
+            result = _mm256_xor_si256(a, splat(0xFF));
+            break;
+        case 0x37:
+            carry = one;
+            break;
+        case 0x3F:
+            carry = _mm256_xor_si256(carry_in, one);
+            break;
+    }
+
+    put(rows, Batch::A, result, mask);
+    put(rows, Batch::F, _mm256_or_si256(_mm256_andnot_si256(one, f), carry), mask);
+}
+
+// Runs one instruction on the lanes in the lanes bitmask, which all have pc
+// at it. next_pc is the address after it.
+AVX2_TARGET static void step_avx2(Batch::Lanes& state, const u8* rom, u8* ram, int lanes,
+                                  u8 opcode, u16 operand, u16 next_pc)
+{
+    Rows& rows = state.rows;
+    const Vec lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const Vec mask = _mm256_cmpeq_epi32(_mm256_and_si256(splat(lanes), lane_bits), lane_bits);
+    const Vec imm = splat(operand);
+    const Vec hl = get_pair(rows, 2);
+
+    Vec pc = splat(next_pc);
+    Vec cycles = splat(CYCLES_TABLE[opcode]);
+
+    const int dst = (opcode >> 3) & 0x07;
+    const int src = opcode & 0x07;
+    const int rp = (opcode >> 4) & 0x03;
+
+    if (opcode >= 0x40 && opcode < 0x80) {
+        if (dst == Batch::M)
+            write8(ram, lanes, hl, get(rows, src));
+        else
+            put(rows, dst, src == Batch::M ? read8(rom, ram, hl) : get(rows, src), mask);
+    }
+    else if (opcode >= 0x80 && opcode < 0xC0)
+        alu(rows, dst, src == Batch::M ? read8(rom, ram, hl) : get(rows, src), mask);
+    else if (opcode < 0x40) {
+        switch (src)
+        {
+            case 0: // NOP
+                break;
+            case 1:
+                if (opcode & 0x08) { // DAD
+                    const Vec sum = _mm256_add_epi32(hl, get_pair(rows, rp));
+                    const Vec f = _mm256_andnot_si256(splat(0x01), get(rows, Batch::F));
+                    put_pair(rows, 2, low_word(sum), mask);
+                    put(rows, Batch::F, _mm256_or_si256(f, _mm256_srli_epi32(sum, 16)), mask);
+                }
+                else                 // LXI
+                    put_pair(rows, rp, imm, mask);
+                break;
+            case 2:
+                switch (opcode)
+                {
+                    case 0x02: write8(ram, lanes, get_pair(rows, 0), get(rows, Batch::A)); break;
+                    case 0x12: write8(ram, lanes, get_pair(rows, 1), get(rows, Batch::A)); break;
+                    case 0x22:
+                        write8(ram, lanes, imm, get(rows, Batch::L));
+                        write8(ram, lanes, splat(static_cast<u16>(operand + 1)), get(rows, Batch::H));
+                        break;
+                    case 0x32: write8(ram, lanes, imm, get(rows, Batch::A)); break;
+                    case 0x0A: put(rows, Batch::A, read8(rom, ram, get_pair(rows, 0)), mask); break;
+                    case 0x1A: put(rows, Batch::A, read8(rom, ram, get_pair(rows, 1)), mask); break;
+                    case 0x2A:
+                        put(rows, Batch::L, read8(rom, ram, imm), mask);
+                        put(rows, Batch::H, read8(rom, ram, splat(static_cast<u16>(operand + 1))), mask);
+                        break;
+                    case 0x3A: put(rows, Batch::A, read8(rom, ram, imm), mask); break;
+                }
+                break;
+            case 3: { // INX, DCX
+                const Vec step = splat(opcode & 0x08 ? -1 : 1);
+                put_pair(rows, rp, low_word(_mm256_add_epi32(get_pair(rows, rp), step)), mask);
+                break;
+            }
+            case 4: case 5: // INR, DCR
+                if (dst == Batch::M)
+                    write8(ram, lanes, hl, inr_dcr(rows, read8(rom, ram, hl), src == 5, mask));
+                else
+                    put(rows, dst, inr_dcr(rows, get(rows, dst), src == 5, mask), mask);
+                break;
+            case 6: // MVI
+                if (dst == Batch::M)
+                    write8(ram, lanes, hl, imm);
+                else
+                    put(rows, dst, imm, mask);
+                break;
+            case 7:
+                if (opcode == 0x27)
+                    daa(rows, mask);
+                else
+                    rotate(rows, opcode, mask);
+                break;
+        }
+    }
+    else {
+        switch (src)
+        {
+            case 0: { // Rcc
+                const Vec taken = _mm256_and_si256(mask, condition(get(rows, Batch::F), opcode));
+                if (lanes_of(taken)) {
+                    pc = _mm256_blendv_epi8(pc, pop16(rows, rom, ram, taken), taken);
+                    cycles = _mm256_add_epi32(cycles, _mm256_and_si256(taken, splat(6)));
+                }
+                break;
+            }
+            case 1:
+                if (!(opcode & 0x08)) { // POP
+                    const Vec value = pop16(rows, rom, ram, mask);
+                    if (rp == 3) {
+                        put(rows, Batch::A, _mm256_srli_epi32(value, 8), mask);
+                        put(rows, Batch::F, low_byte(value), mask);
+                    }
+                    else
+                        put_pair(rows, rp, value, mask);
+                }
+                else if (opcode == 0xE9) // PCHL
+                    pc = hl;
+                else if (opcode == 0xF9) // SPHL
+                    put(rows, Batch::SP, hl, mask);
+                else                     // RET
+                    pc = pop16(rows, rom, ram, mask);
+                break;
+            case 2: // Jcc
+                pc = _mm256_blendv_epi8(pc, imm, condition(get(rows, Batch::F), opcode));
+                break;
+            case 3:
+                switch (opcode)
+                {
+                    case 0xC3: case 0xCB: // JMP
+                        pc = imm;
+                        break;
+                    case 0xD3: // OUT
+                        if (operand == 2)
+                            put(rows, Batch::PORT2O, _mm256_and_si256(get(rows, Batch::A), splat(0x07)), mask);
+                        else if (operand == 4) {
+                            put(rows, Batch::PORT4LO, get(rows, Batch::PORT4HI), mask);
+                            put(rows, Batch::PORT4HI, get(rows, Batch::A), mask);
+                        }
+                        break;
+                    case 0xDB: { // IN
+                        Vec value;
+                        if (operand == 1)
+                            value = _mm256_or_si256(get(rows, Batch::PORT1I), splat(0x08));
+                        else if (operand == 2)
+                            value = get(rows, Batch::PORT2I);
+                        else {
+                            const Vec shift = _mm256_or_si256(_mm256_slli_epi32(get(rows, Batch::PORT4HI), 8),
+                                                              get(rows, Batch::PORT4LO));
+                            value = low_byte(_mm256_srli_epi32(_mm256_sllv_epi32(shift, get(rows, Batch::PORT2O)), 8));
+                        }
+                        put(rows, Batch::A, value, mask);
+                        break;
+                    }
+                    case 0xE3: { // XTHL
+                        const Vec sp = get(rows, Batch::SP);
+                        const Vec next = low_word(_mm256_add_epi32(sp, splat(1)));
+                        const Vec low = read8(rom, ram, sp);
+                        const Vec high = read8(rom, ram, next);
+                        write8(ram, lanes, sp, get(rows, Batch::L));
+                        write8(ram, lanes, next, get(rows, Batch::H));
+                        put(rows, Batch::L, low, mask);
+                        put(rows, Batch::H, high, mask);
+                        break;
+                    }
+                    case 0xEB: { // XCHG
+                        const Vec de = get_pair(rows, 1);
+                        put_pair(rows, 1, hl, mask);
+                        put_pair(rows, 2, de, mask);
+                        break;
+                    }
+                    case 0xF3: case 0xFB: // DI, EI
+                        put(rows, Batch::INTERRUPT_ENABLE, splat(opcode == 0xFB), mask);
+                        break;
+                }
+                break;
+            case 4: { // Ccc
+                const Vec taken = _mm256_and_si256(mask, condition(get(rows, Batch::F), opcode));
+                if (lanes_of(taken)) {
+                    push16(rows, ram, taken, pc);
+                    pc = _mm256_blendv_epi8(pc, imm, taken);
+                    cycles = _mm256_add_epi32(cycles, _mm256_and_si256(taken, splat(6)));
+                }
+                break;
+            }
+            case 5:
+                if (!(opcode & 0x08)) { // PUSH
+                    const Vec af = _mm256_or_si256(_mm256_slli_epi32(get(rows, Batch::A), 8), get(rows, Batch::F));
+                    push16(rows, ram, mask, rp == 3 ? af : get_pair(rows, rp));
+                }
+                else {                  // CALL
+                    push16(rows, ram, mask, pc);
+                    pc = imm;
+                }
+                break;
+            case 6: // ALU immediate
+                alu(rows, dst, imm, mask);
+                break;
+        }
+    }
+
+    put(rows, Batch::PC, pc, mask);
+    put(rows, Batch::CYCLES, _mm256_add_epi32(get(rows, Batch::CYCLES), cycles), mask);
+    put(rows, Batch::STEPS, _mm256_add_epi32(get(rows, Batch::STEPS), splat(1)), mask);
+}
+
+// find_leader() with a horizontal minimum over the pcs of the lanes short
+// of the target, the others having been pushed out of the way
+AVX2_TARGET static int find_leader_avx2(const Batch::Lanes& state, int cycle_target, u16& pc)
+{
+    const Rows& rows = state.rows;
+    const Vec active = _mm256_cmpgt_epi32(splat(cycle_target), get(rows, Batch::CYCLES));
+    if (!lanes_of(active))
+        return 0;
+
+    const Vec pcs = get(rows, Batch::PC);
+    Vec lowest = _mm256_or_si256(pcs, _mm256_xor_si256(active, splat(-1)));
+    lowest = _mm256_min_epu32(lowest, _mm256_permute2x128_si256(lowest, lowest, 0x01));
+    lowest = _mm256_min_epu32(lowest, _mm256_shuffle_epi32(lowest, 0x4E));
+    lowest = _mm256_min_epu32(lowest, _mm256_shuffle_epi32(lowest, 0xB1));
+
+    pc = _mm256_cvtsi256_si32(lowest);
+    return lanes_of(_mm256_and_si256(active, _mm256_cmpeq_epi32(pcs, lowest)));
+}
+#endif
+
+Batch::Batch()
+    :
+    bus{this, 0},
+    cpu{bus}
+{
+#if BATCH_AVX2
+    avx2 = __builtin_cpu_supports("avx2");
+#else
+    avx2 = false;
+#endif
+
+    // as Cpu's constructor leaves it
+    for (int lane = 0; lane < LANES; lane++)
+        lanes.rows[F][lane] = 0x02;
+}
+
+void Batch::set_rom(std::shared_ptr<const Rom> _rom)
+{
+    std::copy(_rom->data.begin(), _rom->data.end(), rom.begin());
+}
+
+void Batch::set_port1(int lane, u8 value)
+{
+    lanes.rows[PORT1I][lane] = value;
+}
+
+// One frame on every lane, as Invaders::execute_instruction() runs it
+void Batch::run_frame()
+{
+    for (int i = 0; i < 2; i++)
+    {
+        run_lanes(cycles_per_interrupt);
+
+        for (int lane = 0; lane < LANES; lane++)
+        {
+            lanes.rows[CYCLES][lane] -= cycles_per_interrupt;
+            interrupt(lane, i ? 0x10 : 0x08);
+        }
+    }
+
+    for (int lane = 0; lane < LANES; lane++)
+    {
+        instructions[lane] += lanes.rows[STEPS][lane];
+        lanes.rows[STEPS][lane] = 0;
+    }
+
+    frames++;
+}
+
+void Batch::run_lanes(int cycle_target)
+{
+    for (;;)
+    {
+        u16 pc;
+        const int at_pc = find_leader(cycle_target, pc);
+        if (!at_pc)
+            return;
+
+#if BATCH_AVX2
+        const u8 opcode = rom[pc & 0x1FFF];
+        const int length = LENGTH_TABLE[opcode];
+        u16 operand = 0;
+        if (length > 1)
+            operand = rom[(pc + 1) & 0x1FFF];
+        if (length > 2)
+            operand |= rom[(pc + 2) & 0x1FFF] << 8;
+
+        if (avx2 && pc + length <= Rom::SIZE && lockstep(opcode, operand)) {
+            step_avx2(lanes, rom.data(), ram.data(), at_pc, opcode, operand, pc + length);
+            vector_steps++;
+            vector_instructions += __builtin_popcount(at_pc);
+            continue;
+        }
+#endif
+
+        for (int lanes_left = at_pc; lanes_left; lanes_left &= lanes_left - 1)
+            step_scalar(__builtin_ctz(lanes_left));
+    }
+}
+
+// Returns the lanes short of cycle_target that share the lowest pc, with
+// that pc, or 0 once every lane has reached the target
+int Batch::find_leader(int cycle_target, u16& pc) const
+{
+#if BATCH_AVX2
+    if (avx2)
+        return find_leader_avx2(lanes, cycle_target, pc);
+#endif
+
+    int at_pc = 0;
+    u32 lowest = 0x10000;
+
+    for (int lane = 0; lane < LANES; lane++)
+    {
+        if (static_cast<int>(lanes.rows[CYCLES][lane]) >= cycle_target)
+            continue;
+
+        const u32 lane_pc = lanes.rows[PC][lane];
+        if (lane_pc < lowest) {
+            lowest = lane_pc;
+            at_pc = 0;
+        }
+        if (lane_pc == lowest)
+            at_pc |= 1 << lane;
+    }
+
+    pc = lowest;
+    return at_pc;
+}
+
+void Batch::step_scalar(int lane)
+{
+    CpuState state;
+    get_cpu(lane, state);
+
+    bus.index = lane;
+    cpu.load_state(state);
+    cpu.execute_instruction();
+    cpu.save_state(state);
+
+    set_cpu(lane, state);
+}
+
+void Batch::interrupt(int lane, u16 addr)
+{
+    u32 (&rows)[FIELD_COUNT][LANES] = lanes.rows;
+    if (!rows[INTERRUPT_ENABLE][lane])
+        return;
+
+    Lane memory{this, lane};
+    const u16 pc = rows[PC][lane];
+    u16 sp = rows[SP][lane];
+    memory.write_byte(--sp, pc >> 8);
+    memory.write_byte(--sp, pc & 0xFF);
+
+    rows[SP][lane] = sp;
+    rows[PC][lane] = addr;
+    rows[INTERRUPT_ENABLE][lane] = 0;
+}
+
+void Batch::get_cpu(int lane, CpuState& state) const
+{
+    const u32 (&rows)[FIELD_COUNT][LANES] = lanes.rows;
+
+    state = {};
+    state.instructions = instructions[lane] + rows[STEPS][lane];
+    state.cycles = rows[CYCLES][lane];
+    state.pc = rows[PC][lane];
+    state.sp = rows[SP][lane];
+    state.A = rows[A][lane];
+    state.B = rows[B][lane];
+    state.C = rows[C][lane];
+    state.D = rows[D][lane];
+    state.E = rows[E][lane];
+    state.H = rows[H][lane];
+    state.L = rows[L][lane];
+    state.F = rows[F][lane];
+    state.halted = rows[HALTED][lane];
+    state.interrupt_enable = rows[INTERRUPT_ENABLE][lane];
+}
+
+void Batch::set_cpu(int lane, const CpuState& state)
+{
+    u32 (&rows)[FIELD_COUNT][LANES] = lanes.rows;
+
+    instructions[lane] = state.instructions;
+    rows[STEPS][lane] = 0;
+    rows[CYCLES][lane] = state.cycles;
+    rows[PC][lane] = state.pc;
+    rows[SP][lane] = state.sp;
+    rows[A][lane] = state.A;
+    rows[B][lane] = state.B;
+    rows[C][lane] = state.C;
+    rows[D][lane] = state.D;
+    rows[E][lane] = state.E;
+    rows[H][lane] = state.H;
+    rows[L][lane] = state.L;
+    rows[F][lane] = state.F;
+    rows[HALTED][lane] = state.halted;
+    rows[INTERRUPT_ENABLE][lane] = state.interrupt_enable;
+}
+
+// The same bytes Invaders::save_state() writes for a machine in this state
+void Batch::save_state(int lane, SaveState& state) const
+{
+    const u32 (&rows)[FIELD_COUNT][LANES] = lanes.rows;
+
+    state = {};
+    state.set_header();
+    get_cpu(lane, state.cpu);
+
+    for (int i = 0; i < RAM_SIZE; i++)
+        state.ram[i] = ram[i * LANES + lane];
+
+    state.io.frames = frames;
+    state.io.port1i = rows[PORT1I][lane];
+    state.io.port2i = rows[PORT2I][lane];
+    state.io.port2o = rows[PORT2O][lane];
+    state.io.port3o = rows[PORT3O][lane];
+    state.io.port4lo = rows[PORT4LO][lane];
+    state.io.port4hi = rows[PORT4HI][lane];
+    state.io.port5o = rows[PORT5O][lane];
+}
+
+// The frame count is shared by all lanes, so the one in state is ignored
+bool Batch::load_state(int lane, const SaveState& state)
+{
+    if (!state.has_header())
+        return false;
+
+    u32 (&rows)[FIELD_COUNT][LANES] = lanes.rows;
+
+    set_cpu(lane, state.cpu);
+
+    for (int i = 0; i < RAM_SIZE; i++)
+        ram[i * LANES + lane] = state.ram[i];
+
+    rows[PORT1I][lane] = state.io.port1i;
+    rows[PORT2I][lane] = state.io.port2i;
+    rows[PORT2O][lane] = state.io.port2o;
+    rows[PORT3O][lane] = state.io.port3o;
+    rows[PORT4LO][lane] = state.io.port4lo;
+    rows[PORT4HI][lane] = state.io.port4hi;
+    rows[PORT5O][lane] = state.io.port5o;
+    return true;
+}
+
+u64 Batch::get_frames() const
+{
+    return frames;
+}
+
+u64 Batch::get_instructions() const
+{
+    u64 total = 0;
+    for (int lane = 0; lane < LANES; lane++)
+        total += instructions[lane] + lanes.rows[STEPS][lane];
+    return total;
+}
+
+// Steps run with AVX2, and the lane instructions they covered
+u64 Batch::get_vector_steps() const
+{
+    return vector_steps;
+}
+
+u64 Batch::get_vector_instructions() const
+{
+    return vector_instructions;
+}
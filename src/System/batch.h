@@ -0,0 +1,152 @@
+#pragma once
+#include <array>
+#include <memory>
+#include "../8080/types.h"
+#include "../8080/cpu.h"
+#include "rom.h"
+#include "save_state.h"
+
+// Experimental lockstep core for running many copies of the game at once.
+// LANES machines are kept in structure-of-arrays form: every register, flag
+// byte and port is a row of LANES 32-bit values, and RAM is interleaved so
+// that lane l's byte at address a lives at ram[(a & 0x1FFF) * LANES + l].
+//
+// Each step takes the lowest pc among the lanes that have not reached the
+// cycle target and runs that one instruction with AVX2 on every lane sitting
+// at it; the others wait until the lowest pc is theirs, which also lets
+// lanes that split up meet again. HLT, RST, unknown IN ports, code outside
+// the ROM and CPUs without AVX2 go through a scalar Cpu one lane at a time
+// instead. Either way every lane ends each frame in exactly the state an
+// Invaders given the same inputs would.
+class Batch
+{
+    public:
+    static constexpr int LANES = 8;
+
+    Batch();
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+
+    void set_rom(std::shared_ptr<const Rom> rom);
+    void run_frame();
+    void set_port1(int lane, u8 value);
+
+    void save_state(int lane, SaveState& state) const;
+    bool load_state(int lane, const SaveState& state);
+
+    u64 get_frames() const;
+    u64 get_instructions() const;
+    u64 get_vector_steps() const;
+    u64 get_vector_instructions() const;
+
+    // One row of LANES values each. The registers are in the order the
+    // opcodes number them; M is (HL) and its row is never used.
+    enum Field {
+        B, C, D, E, H, L, M, A, F,
+        SP, PC, CYCLES, STEPS, INTERRUPT_ENABLE, HALTED,
+        PORT1I, PORT2I, PORT2O, PORT3O, PORT4LO, PORT4HI, PORT5O,
+        FIELD_COUNT
+    };
+
+    struct alignas(32) Lanes {
+        u32 rows[FIELD_COUNT][LANES];
+    };
+
+    // Memory and ports of a single lane, as the bus of the scalar Cpu
+    struct Lane {
+        Batch* batch;
+        int index;
+
+        u8 read_byte(u16 addr) const;
+        u16 read_word(u16 addr) const;
+        void write_byte(u16 addr, u8 data);
+        void write_word(u16 addr, u16 data);
+        u8 read_port(u8 port);
+        void write_port(u8 port, u8 data);
+    };
+
+    private:
+    void run_lanes(int cycle_target);
+    int find_leader(int cycle_target, u16& pc) const;
+    void step_scalar(int lane);
+    void interrupt(int lane, u16 addr);
+    void get_cpu(int lane, CpuState& state) const;
+    void set_cpu(int lane, const CpuState& state);
+
+    static constexpr int cycles_per_interrupt = 2000000 / (60 * 2);
+    static constexpr int RAM_SIZE = 0x2000;
+
+    Lanes lanes = {};
+
+    // Both padded so the 4-byte gathers of the last byte stay inside
+    alignas(32) std::array<u8, RAM_SIZE * LANES + 3> ram = {};
+    std::array<u8, Rom::SIZE + 3> rom = {};
+
+    Lane bus;
+    Cpu<Lane> cpu;
+    bool avx2;
+
+    std::array<u64, LANES> instructions = {};
+    u64 frames = 0;
+    u64 vector_steps = 0;
+    u64 vector_instructions = 0;
+};
+
+// The same map as Invaders::map_pages(): A15 ignored, ROM, then RAM, then
+// nothing at 0x4000-0x5FFF, then the RAM mirror. Only RAM takes writes.
+inline u8 Batch::Lane::read_byte(u16 addr) const
+{
+    switch ((addr >> 13) & 0x03)
+    {
+        case 0:  return batch->rom[addr & 0x1FFF];
+        case 2:  return 0xFF;
+        default: return batch->ram[(addr & 0x1FFF) * LANES + index];
+    }
+}
+
+inline u16 Batch::Lane::read_word(u16 addr) const
+{
+    return read_byte(addr) | static_cast<u16>(read_byte(addr + 1) << 8);
+}
+
+inline void Batch::Lane::write_byte(u16 addr, u8 data)
+{
+    if (addr & 0x2000)
+        batch->ram[(addr & 0x1FFF) * LANES + index] = data;
+}
+
+inline void Batch::Lane::write_word(u16 addr, u16 data)
+{
+    write_byte(addr, data & 0xFF);
+    write_byte(addr + 1, data >> 8);
+}
+
+// Unknown ports read as 0; the lockstep path never sends them here
+inline u8 Batch::Lane::read_port(u8 port)
+{
+    const u32 (&rows)[FIELD_COUNT][LANES] = batch->lanes.rows;
+
+    switch (port)
+    {
+        case 1:  return rows[PORT1I][index] | 0x08;
+        case 2:  return rows[PORT2I][index];
+        case 3:  return ((rows[PORT4HI][index] << 8 | rows[PORT4LO][index]) << rows[PORT2O][index]) >> 8;
+        default: return 0;
+    }
+}
+
+inline void Batch::Lane::write_port(u8 port, u8 data)
+{
+    u32 (&rows)[FIELD_COUNT][LANES] = batch->lanes.rows;
+
+    switch (port)
+    {
+        case 2:
+            rows[PORT2O][index] = data & 0x07;
+            break;
+        case 4:
+            rows[PORT4LO][index] = rows[PORT4HI][index];
+            rows[PORT4HI][index] = data;
+            break;
+    }
+}
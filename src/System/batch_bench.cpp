@@ -0,0 +1,162 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "batch.h"
+#include "runner.h"
+
+// The lockstep batch core against the scalar runner: the same machines fed
+// the same inputs, once as Invaders on a single Runner worker and once as
+// Batches of Batch::LANES, so both use one core. Every instance picks a new
+// input each round from a random sequence of its own, or with --same-input
+// all of them follow the first one's, which keeps every lane in step.
+
+// none, fire, left, right, fire + left, fire + right, coin, 1P start
+static constexpr u8 INPUTS[] = {0x00, 0x10, 0x20, 0x40, 0x30, 0x50, 0x01, 0x04};
+
+static void usage(const char* name)
+{
+    printf("usage: %s <rom> [--instances M] [--frames N] [--round F] [--same-input] [--check]\n", name);
+}
+
+class Inputs
+{
+    public:
+    Inputs(int instances, bool same)
+    {
+        for (int i = 0; i < instances; i++)
+            seeds.push_back(same ? 1 : 2654435761u * (i + 1));
+    }
+
+    u8 next(int instance)
+    {
+        u32& x = seeds[instance];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return INPUTS[x % sizeof(INPUTS)];
+    }
+
+    private:
+    std::vector<u32> seeds;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int instances = 64;
+    int frames = 600;
+    int round = 4;
+    bool same = false;
+    bool check = false;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--instances") && i + 1 < argc)
+            instances = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--round") && i + 1 < argc)
+            round = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--same-input"))
+            same = true;
+        else if (!strcmp(argv[i], "--check"))
+            check = true;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (instances < 1 || frames < 1 || round < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const int batch_count = (instances + Batch::LANES - 1) / Batch::LANES;
+    instances = batch_count * Batch::LANES;
+    const int rounds = (frames + round - 1) / round;
+
+    printf("%d instances, %d frames each in rounds of %d, %s inputs\n\n",
+           instances, rounds * round, round, same ? "the same" : "different");
+
+    Runner runner(argv[1], instances, 1);
+    Inputs runner_inputs(instances, same);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < instances; i++)
+            runner.set_port1(i, runner_inputs.next(i));
+        runner.run(round);
+    }
+    const double runner_seconds = seconds_since(start);
+
+    const std::shared_ptr<const Rom> rom = Rom::load(argv[1]);
+    std::vector<std::unique_ptr<Batch>> batches;
+    for (int b = 0; b < batch_count; b++)
+    {
+        batches.push_back(std::make_unique<Batch>());
+        batches.back()->set_rom(rom);
+    }
+    Inputs batch_inputs(instances, same);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < instances; i++)
+            batches[i / Batch::LANES]->set_port1(i % Batch::LANES, batch_inputs.next(i));
+        for (auto& batch : batches)
+            for (int f = 0; f < round; f++)
+                batch->run_frame();
+    }
+    const double batch_seconds = seconds_since(start);
+
+    u64 instructions = 0;
+    u64 vector_steps = 0;
+    u64 vector_instructions = 0;
+    for (const auto& batch : batches)
+    {
+        instructions += batch->get_instructions();
+        vector_steps += batch->get_vector_steps();
+        vector_instructions += batch->get_vector_instructions();
+    }
+
+    const double total_frames = static_cast<double>(instances) * rounds * round;
+    printf("               frames/s    instr/s   speedup\n");
+    printf("runner       %10.0f  %8.1f M\n", total_frames / runner_seconds,
+           runner.get_instructions() / runner_seconds / 1e6);
+    printf("batch        %10.0f  %8.1f M  %7.2fx\n\n", total_frames / batch_seconds,
+           instructions / batch_seconds / 1e6, runner_seconds / batch_seconds);
+    printf("lockstep: %.1f%% of instructions, %.2f lanes per step\n",
+           instructions ? 100.0 * vector_instructions / instructions : 0.0,
+           vector_steps ? static_cast<double>(vector_instructions) / vector_steps : 0.0);
+
+    if (!check)
+        return 0;
+
+    int mismatches = 0;
+    for (int i = 0; i < instances; i++)
+    {
+        SaveState scalar;
+        SaveState lane;
+        runner.get_machine(i).save_state(scalar);
+        batches[i / Batch::LANES]->save_state(i % Batch::LANES, lane);
+        if (std::memcmp(&scalar, &lane, sizeof(SaveState)))
+            mismatches++;
+    }
+
+    printf("check: %d of %d instances differ\n", mismatches, instances);
+    return mismatches != 0;
+}
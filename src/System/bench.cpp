@@ -0,0 +1,235 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "invaders.h"
+#include "movie.h"
+#include "pacer.h"
+#include "rewind.h"
+
+// Headless throughput benchmark: runs the machine without a window or
+// frame limiter and reports emulated frames/s, instructions/s and cycles/s.
+// --check instead runs the machine, as the other flags set it up, next to a
+// purely interpreted one, with neither blocks nor idle skipping, and
+// compares them after every frame.
+// --replay feeds the input of a movie and checks the RAM hash it recorded
+// after every frame, so runs of the same movie do exactly the same work.
+// --beam runs every frame band by band as the window does with beam racing,
+// and --render then draws each band.
+// --paced holds the run to 60 frames/s as the game does and reports how
+// long frames took to run and how late the pacer woke up.
+
+static void usage(const char* name)
+{
+    printf("usage: %s <rom> [--frames N] [--no-blocks] [--no-idle-skip] [--jit] [--render] [--beam]\n"
+           "       [--paced] [--rewind] [--check] [--record FILE] [--replay FILE]\n", name);
+}
+
+static int check(const char* rom, u64 frames, bool blocks, bool idle_skip, bool jit, bool beam)
+{
+    Invaders native;
+    native.load_rom(rom);
+    native.set_block_cache(blocks);
+    native.set_idle_skip(idle_skip);
+    native.set_jit(jit);
+    native.set_beam(beam);
+
+    Invaders interpreted;
+    interpreted.load_rom(rom);
+    interpreted.set_recompiled(false);
+    interpreted.set_block_cache(false);
+
+    for (u64 i = 0; i < frames; i++)
+    {
+        native.execute_instruction();
+        interpreted.execute_instruction();
+
+        if (!native.same_state(interpreted)) {
+            printf("diverges from the interpreter in frame %llu\n",
+                   static_cast<unsigned long long>(i));
+            return 1;
+        }
+    }
+
+    printf("matches the interpreter for %llu frames\n",
+           static_cast<unsigned long long>(frames));
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    u64 frames = 6000;
+    bool blocks = true;
+    bool idle_skip = true;
+    bool jit = false;
+    bool render = false;
+    bool beam = false;
+    bool paced = false;
+    bool rewind = false;
+    bool check_engine = false;
+    bool frames_set = false;
+    const char* record = nullptr;
+    const char* replay = nullptr;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = strtoull(argv[++i], nullptr, 10);
+            frames_set = true;
+        }
+        else if (!strcmp(argv[i], "--no-blocks"))
+            blocks = false;
+        else if (!strcmp(argv[i], "--no-idle-skip"))
+            idle_skip = false;
+        else if (!strcmp(argv[i], "--jit"))
+            jit = true;
+        else if (!strcmp(argv[i], "--render"))
+            render = true;
+        else if (!strcmp(argv[i], "--beam"))
+            beam = true;
+        else if (!strcmp(argv[i], "--paced"))
+            paced = true;
+        else if (!strcmp(argv[i], "--rewind"))
+            rewind = true;
+        else if (!strcmp(argv[i], "--check"))
+            check_engine = true;
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            record = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            replay = argv[++i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (check_engine)
+        return check(argv[1], frames, blocks, idle_skip, jit, beam);
+
+    Movie movie;
+    if (replay) {
+        if (!movie.load(replay)) {
+            printf("cannot read movie %s\n", replay);
+            return 1;
+        }
+        if (!frames_set)
+            frames = movie.get_frames();
+    }
+
+    Invaders invaders;
+    invaders.load_rom(argv[1]);
+    invaders.set_block_cache(blocks);
+    invaders.set_idle_skip(idle_skip);
+    invaders.set_jit(jit);
+    invaders.set_beam(beam);
+
+    Frame frame = {};
+    Screen screen;
+    Rewind history;
+    SaveState state;
+    std::chrono::steady_clock::duration capture{};
+    u64 diverged = frames;
+    Histogram frame_times;
+
+    const auto start = std::chrono::steady_clock::now();
+    Pacer pacer(60);
+
+    for (u64 i = 0; i < frames; i++)
+    {
+        if (replay)
+            invaders.set_port1(movie.port1_at(i));
+
+        const u8 port1 = invaders.get_port1();
+        const auto frame_start = paced ? std::chrono::steady_clock::now() : start;
+        if (beam) {
+            for (int first_row = 0; first_row < VRAM_ROWS;)
+            {
+                const int end_row = invaders.run_band();
+                if (render) {
+                    invaders.capture_rows(frame, first_row, end_row);
+                    screen.update(frame, false);
+                }
+                first_row = end_row;
+            }
+        }
+        else
+            invaders.execute_instruction();
+
+        if (replay || record) {
+            const u32 hash = invaders.ram_hash();
+            if (replay && !movie.check(i, hash)) {
+                diverged = i;
+                break;
+            }
+            if (record)
+                movie.record(i, port1, hash);
+        }
+
+        if (render && !beam) {
+            invaders.capture_frame(frame);
+            screen.update(frame, false);
+        }
+        if (rewind) {
+            const auto before = std::chrono::steady_clock::now();
+            invaders.save_state(state);
+            history.push(state);
+            capture += std::chrono::steady_clock::now() - before;
+        }
+        if (paced) {
+            frame_times.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - frame_start).count());
+            pacer.wait();
+        }
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    const double fps = invaders.get_frames() / seconds;
+    const double ips = invaders.get_instructions() / seconds;
+    const double cps = invaders.get_total_cycles() / seconds;
+
+    printf("frames        %llu\n", static_cast<unsigned long long>(invaders.get_frames()));
+    printf("instructions  %llu\n", static_cast<unsigned long long>(invaders.get_instructions()));
+    printf("cycles        %llu\n", static_cast<unsigned long long>(invaders.get_total_cycles()));
+    printf("time          %.3f s\n", seconds);
+    printf("frames/s      %.1f (%.1fx real time)\n", fps, fps / 60.0);
+    printf("instr/s       %.2f M\n", ips / 1e6);
+    printf("cycles/s      %.2f M\n", cps / 1e6);
+
+    if (replay) {
+        if (diverged < frames)
+            printf("replay        diverges from the movie in frame %llu\n",
+                   static_cast<unsigned long long>(diverged));
+        else
+            printf("replay        matches the movie\n");
+    }
+
+    if (paced) {
+        printf("paced         %.4f frames/s\n", pacer.get_rate());
+        printf("frame time    p50 %.1f us, p99 %.1f us, max %.1f us\n", frame_times.percentile(50) / 1e3,
+               frame_times.percentile(99) / 1e3, frame_times.get_max() / 1e3);
+        const Histogram& late = pacer.get_lateness();
+        printf("late          p50 %.1f us, p99 %.1f us, max %.1f us\n", late.percentile(50) / 1e3,
+               late.percentile(99) / 1e3, late.get_max() / 1e3);
+    }
+
+    if (record && !movie.save(record))
+        printf("cannot write movie %s\n", record);
+
+    if (rewind) {
+        // Against the time a frame took here, not a 60 Hz frame
+        const double per_frame = std::chrono::duration<double>(capture).count() / invaders.get_frames();
+        const double frame_time = seconds / invaders.get_frames();
+        printf("rewind        %.2f us/frame (%.2f%% of the frame time), %zu frames in %.2f MB\n",
+               per_frame * 1e6, per_frame / frame_time * 100, history.get_count(),
+               history.get_bytes() / double(1 << 20));
+    }
+
+    return diverged < frames;
+}
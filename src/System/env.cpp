@@ -0,0 +1,130 @@
+#include "env.h"
+
+// Where the original ROM keeps its game state
+static constexpr u16 GAME_MODE = 0x20EF;   // 1 while a game is running
+static constexpr u16 P1_SCORE  = 0x20F8;   // 4 BCD digits, low byte first
+static constexpr u16 P1_SHIPS  = 0x21FF;   // ships left besides the current one
+
+static constexpr u8 COIN     = 0x01;
+static constexpr u8 P1_START = 0x04;
+
+static constexpr u8 ACTION_PORT1[Env::ACTION_COUNT] = {
+    0x00,           // Noop
+    0x10,           // Fire
+    0x40,           // Right
+    0x20,           // Left
+    0x50,           // RightFire
+    0x30            // LeftFire
+};
+
+static int from_bcd(u8 data)
+{
+    return (data >> 4) * 10 + (data & 0x0F);
+}
+
+bool Env::load_rom(const char* file_name)
+{
+    return set_rom(Rom::load(file_name));
+}
+
+// Fails if the ROM never starts a game, i.e. it is not Space Invaders
+bool Env::set_rom(std::shared_ptr<const Rom> rom)
+{
+    invaders.set_rom(std::move(rom));
+
+    run(120);
+    invaders.set_port1(COIN);
+    run(5);
+    invaders.set_port1(0);
+    run(60);
+    invaders.set_port1(P1_START);
+    run(5);
+    invaders.set_port1(0);
+
+    for (int i = 0; i < 600 && invaders.read_byte(GAME_MODE) != 1; i++)
+        run(1);
+
+    started = invaders.read_byte(GAME_MODE) == 1;
+    if (started)
+        invaders.save_state(start);
+
+    return started && reset();
+}
+
+bool Env::reset()
+{
+    if (!started)
+        return false;
+
+    invaders.load_state(start);
+    score = read_score();
+    done = false;
+    return true;
+}
+
+// Holds the action's buttons for frameskip frames, or until the game ends
+Env::StepResult Env::step(int action, int frameskip)
+{
+    StepResult result = {0, done};
+    if (done)
+        return result;
+
+    invaders.set_port1(action >= 0 && action < ACTION_COUNT ? ACTION_PORT1[action] : 0);
+
+    for (int i = 0; i < frameskip && !done; i++)
+    {
+        invaders.execute_instruction();
+
+        const int now = read_score();
+        result.reward += now - score;
+        score = now;
+        done = invaders.read_byte(GAME_MODE) != 1;
+    }
+
+    result.done = done;
+    return result;
+}
+
+// pixels receives OBSERVATION_SIZE bytes, see expand_vram_mono()
+void Env::observe(u8* pixels) const
+{
+    expand_vram_mono(invaders.get_vram(), pixels);
+}
+
+int Env::get_score() const
+{
+    return score;
+}
+
+// Ships in reserve, not counting the one in play
+int Env::get_lives() const
+{
+    return invaders.read_byte(P1_SHIPS);
+}
+
+bool Env::is_done() const
+{
+    return done;
+}
+
+const Invaders& Env::get_machine() const
+{
+    return invaders;
+}
+
+void Env::run(int frames)
+{
+    for (int i = 0; i < frames; i++)
+        invaders.execute_instruction();
+}
+
+int Env::read_score() const
+{
+    return from_bcd(invaders.read_byte(P1_SCORE + 1)) * 100 + from_bcd(invaders.read_byte(P1_SCORE));
+}
+
+void step_many(Env* envs, size_t count, const u8* actions, int frameskip, Env::StepResult* results)
+{
+    for (size_t i = 0; i < count; i++)
+        results[i] = envs[i].step(actions[i], frameskip);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include "invaders.h"
+
+// Headless Space Invaders episodes for training agents. load_rom() boots
+// the machine, inserts a coin and starts a one player game, and keeps that
+// moment as a save state, so reset() is a single load_state(). An episode
+// ends when the game returns to attract mode. Rewards are increases of the
+// player 1 score. Envs share nothing but the read-only ROM, so an array of
+// them can be stepped from any number of threads as long as each Env stays
+// on one.
+class Env
+{
+    public:
+    // Same set as the Arcade Learning Environment's minimal Space Invaders
+    // actions
+    enum Action : u8 {
+        Noop,
+        Fire,
+        Right,
+        Left,
+        RightFire,
+        LeftFire
+    };
+
+    static constexpr int ACTION_COUNT = 6;
+    static constexpr int OBSERVATION_SIZE = SCREEN_WIDTH * SCREEN_HEIGHT;
+
+    struct StepResult {
+        int reward;
+        bool done;
+    };
+
+    Env() = default;
+    Env(const Env&) = delete;
+    Env& operator=(const Env&) = delete;
+
+    bool load_rom(const char* file_name);
+    bool set_rom(std::shared_ptr<const Rom> rom);
+    bool reset();
+    StepResult step(int action, int frameskip = 1);
+    void observe(u8* pixels) const;
+
+    int get_score() const;
+    int get_lives() const;
+    bool is_done() const;
+    const Invaders& get_machine() const;
+
+    private:
+    void run(int frames);
+    int read_score() const;
+
+    Invaders invaders;
+    SaveState start = {};
+    bool started = false;
+    int score = 0;
+    bool done = true;
+};
+
+// Steps envs[i] with actions[i] into results[i], for count Envs
+void step_many(Env* envs, size_t count, const u8* actions, int frameskip, Env::StepResult* results);
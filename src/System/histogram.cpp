@@ -0,0 +1,63 @@
+#include "histogram.h"
+
+void Histogram::add(u64 ns)
+{
+    int bucket = static_cast<int>(ns);
+
+    if (ns >= 2 * SUB_BUCKETS) {
+        // ns >> shift is in [SUB_BUCKETS, 2 * SUB_BUCKETS)
+        const int shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+        bucket = (shift + 1) * SUB_BUCKETS + static_cast<int>(ns >> shift) - SUB_BUCKETS;
+    }
+
+    counts[bucket]++;
+    count++;
+    if (ns > max)
+        max = ns;
+}
+
+void Histogram::clear()
+{
+    counts = {};
+    count = 0;
+    max = 0;
+}
+
+u64 Histogram::get_count() const
+{
+    return count;
+}
+
+u64 Histogram::get_max() const
+{
+    return max;
+}
+
+// The highest value the bucket holding the p-th percentile could have, but
+// never above the maximum
+u64 Histogram::percentile(double p) const
+{
+    if (!count)
+        return 0;
+
+    u64 rank = static_cast<u64>(p / 100 * count + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    u64 seen = 0;
+    for (int bucket = 0; bucket < static_cast<int>(counts.size()); bucket++)
+    {
+        seen += counts[bucket];
+        if (seen < rank)
+            continue;
+
+        if (bucket < 2 * SUB_BUCKETS)
+            return bucket;
+
+        const int shift = bucket / SUB_BUCKETS - 1;
+        const u64 top = ((u64(bucket % SUB_BUCKETS + SUB_BUCKETS) + 1) << shift) - 1;
+        return top < max ? top : max;
+    }
+
+    return max;
+}
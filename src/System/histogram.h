@@ -0,0 +1,25 @@
+#pragma once
+#include <array>
+#include "../8080/types.h"
+
+// Counts durations in nanoseconds. Values below 128 get a bucket each; past
+// that every power of two is split into 64 buckets, so a percentile comes
+// back at most 1/64 above the real value. The maximum is kept exactly.
+class Histogram
+{
+    public:
+    void add(u64 ns);
+    void clear();
+
+    u64 get_count() const;
+    u64 get_max() const;
+    u64 percentile(double p) const; // p in [0, 100]
+
+    private:
+    static constexpr int SUB_BITS = 6;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BITS;
+
+    std::array<u32, (64 - SUB_BITS + 1) * SUB_BUCKETS> counts = {};
+    u64 count = 0;
+    u64 max = 0;
+};
@@ -1,203 +1,312 @@
-#include <fstream>
-#include <iterator>
+#include <cstdio>
 #include "invaders.h"
+#include "../8080/cpu_impl.h"
+
+template class Cpu<Invaders>;
+
+// Machine state, page table and engine bookkeeping; the ROM, the blocks
+// decoded from it and any pixels live elsewhere so that many instances pack
+// densely. Without set_jit() this is all an instance takes: nothing else is
+// allocated per instance. It is not a POD, since it holds the shared ROM,
+// so copy machines with save_state() rather than as raw bytes.
+static_assert(sizeof(Invaders) <= 9 * 1024, "Invaders grew past 9 KB");
 
 Invaders::Invaders()
     :
     cpu{*this}
 {
+    scheduler.add(cycles_per_interrupt, Event::MidScreen);
+    scheduler.add(cycles_per_frame, Event::VBlank);
+    scheduler.add(cycles_per_frame, Event::FrameEnd);
+
+    map_pages();
+    mark_display_dirty();
 }
 
 void Invaders::execute_instruction()
 {
-    for (int i = 0; i < 2; i++) {
-        
-        while (cpu.get_cycles() < cycles_per_interrupt)
-            cpu.execute_instruction();
-    
-    cpu.set_cycles(cpu.get_cycles() - cycles_per_interrupt);
-
-    cpu.interrupt(i ? 0x10 : 0x08);
-    }
+    while (run_band() < VRAM_ROWS) {}
 }
 
-void Invaders::handle_event(sf::Event& ev)
+// Runs the frame on until the beam has scanned its next band of rows, or to
+// the end without set_beam(). Returns how many VRAM rows the beam has
+// covered, VRAM_ROWS once the frame is done.
+int Invaders::run_band()
 {
-    if (ev.type == sf::Event::KeyPressed)
+    for (;;)
     {
-        switch (ev.key.code)
+        const auto& next = scheduler.next();
+        cpu.run(next.cycle);
+
+        switch (next.event)
         {
-            case sf::Keyboard::Left:
-                port1i |= 0x20;
-                break;
-            case sf::Keyboard::Right:
-                port1i |= 0x40;
-                break;
-            case sf::Keyboard::Space:   // shooot
-                port1i |= 0x10;
-                break;
-            case sf::Keyboard::C:       // credit
-                port1i |= 0x1;
-                break;
-            case sf::Keyboard::Num1:    // 1p
-                port1i |= 0x4;
+            case Event::Band: {
+                // The event is on the first cycle at or past the end of
+                // the band, which rounds back down to its last row
+                const int rows = next.cycle * VRAM_ROWS / cycles_per_frame;
+                scheduler.advance();
+                return rows;
+            }
+            case Event::MidScreen:
+                cpu.interrupt(0x08);
                 break;
-            case sf::Keyboard::Num2:    // 2p
-                port1i |= 0x2;;
-                break;
-            default:
+            case Event::VBlank:
+                cpu.interrupt(0x10);
                 break;
+            case Event::FrameEnd:
+                cpu.set_cycles(cpu.get_cycles() - cycles_per_frame);
+                frames++;
+                scheduler.advance();
+                return VRAM_ROWS;
         }
+
+        scheduler.advance();
     }
+}
+
+u64 Invaders::get_frames() const
+{
+    return frames;
+}
+
+u64 Invaders::get_instructions() const
+{
+    return cpu.get_instructions();
+}
+
+u64 Invaders::get_total_cycles() const
+{
+    return frames * cycles_per_frame + cpu.get_cycles();
+}
 
-    if (ev.type == sf::Event::KeyReleased)
+// Hash of RAM and VRAM, to check that two runs stay in step
+u32 Invaders::ram_hash() const
+{
+    u64 hash = 0;
+    for (size_t i = 0; i < ram.size(); i += sizeof(u64))
     {
-        switch (ev.key.code)
-        {
-             case sf::Keyboard::Left:
-                port1i &= ~0x20;
-                break;
-            case sf::Keyboard::Right:
-                port1i &= ~0x40;
-                break;
-            case sf::Keyboard::Space:
-                port1i &= ~0x10;
-                break;
-            case sf::Keyboard::C:
-                port1i &= ~0x1;
-                break;
-            case sf::Keyboard::Num1:
-                port1i &= ~0x4;
-                break;
-            case sf::Keyboard::Num2:
-                port1i &= ~0x2;;
-                break;
-            default:
-                break;
-        }
+        u64 word;
+        std::memcpy(&word, &ram[i], sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
     }
+
+    return static_cast<u32>(hash ^ hash >> 32);
 }
 
+void Invaders::set_port1(u8 bits, bool pressed)
+{
+    if (pressed)
+        port1i |= bits;
+    else
+        port1i &= ~bits;
+}
 
-void Invaders::render(sf::RenderWindow& window)
+void Invaders::set_port1(u8 value)
 {
-    int offset = 0x2400 - 0x2000;
-    for (int i = 0; i < WIDTH * HEIGHT; i++)
-    {
-        const auto byte_index = i / 8;
-        const auto bit_index = i % 8;
+    port1i = value;
+}
+
+u8 Invaders::get_port1() const
+{
+    return port1i;
+}
+
+// Copies VRAM into frame, along with the rows written since the last capture
+void Invaders::capture_frame(Frame& frame)
+{
+    std::memcpy(frame.vram.data(), get_vram(), frame.vram.size());
+    frame.dirty = dirty_rows;
+    dirty_rows = {};
+}
 
-        const auto val = ram[offset + byte_index] & (1 << bit_index);
+// Copies VRAM rows [first_row, end_row) into frame and hands over just their
+// dirty bits; the rest of frame is left as it was
+void Invaders::capture_rows(Frame& frame, int first_row, int end_row)
+{
+    std::memcpy(frame.vram.data() + first_row * VRAM_ROW_BYTES, get_vram() + first_row * VRAM_ROW_BYTES,
+                (end_row - first_row) * VRAM_ROW_BYTES);
 
+    frame.dirty = {};
+    for (int row = first_row; row < end_row; row++)
+    {
+        const u64 bit = u64(1) << (row % 64);
+        frame.dirty[row / 64] |= dirty_rows[row / 64] & bit;
+        dirty_rows[row / 64] &= ~bit;
+    }
+}
 
-        display[i*4 + 0] = val ? 255 : 0;
-        display[i*4 + 1] = val ? 255 : 0;
-        display[i*4 + 2] = val ? 255 : 0;
-        display[i*4 + 3] = val ? 255 : 0;
-    } 
+// 0x2400-0x3FFF, VRAM_ROWS rows of VRAM_ROW_BYTES
+const u8* Invaders::get_vram() const
+{
+    return ram.data() + 0x2400 - 0x2000;
+}
 
-    sf::Image image;
-	image.create(WIDTH, HEIGHT, display.data());
+void Invaders::mark_display_dirty()
+{
+    dirty_rows.fill(~u64(0));
+}
 
-	sf::Texture texture;
-	texture.loadFromImage(image);
-	sf::Sprite sprite;
-	sprite.setTexture(texture, true);
-    sprite.setScale(1.8f,1.8f);
-    sprite.rotate(-90.f);
-    sprite.move(0, sprite.getGlobalBounds().height);
 
-	window.clear();
-	window.draw(sprite);
-	window.display(); 
+void Invaders::load_rom(const char* file_name)
+{
+    set_rom(Rom::load(file_name));
 }
 
+void Invaders::set_rom(std::shared_ptr<const Rom> _rom)
+{
+    rom = std::move(_rom);
+    map_pages();
+    set_block_cache(true);
+    set_recompiled(true);
+}
 
-u8 Invaders::read_byte(u16 addr) const 
+void Invaders::set_block_cache(bool enable)
 {
-    if (addr >= 0x2000 && addr < 0x4000)
-        return ram[addr-0x2000];
-    
-    else if (addr >= 0x0000 && addr < 0x2000)
-        return rom[addr];
+    if (enable && rom)
+        cpu.set_code_cache(std::shared_ptr<const CodeCache>(rom, &rom->code));
+    else
+        cpu.set_code_cache(nullptr);
+}
 
-    return 0xFF;
-    
-   //return rom[addr];
+void Invaders::set_jit(bool enable)
+{
+    cpu.set_jit(enable);
+}
+
+// Only has an effect in the spaceinvaders-aot build, and only with the ROM
+// it was recompiled from
+bool Invaders::set_recompiled(bool enable)
+{
+    return cpu.set_recompiled(enable);
 }
 
-u16 Invaders::read_word(u16 addr) const 
+// Wait loops and HLT skip ahead to the next interrupt unless this is off
+void Invaders::set_idle_skip(bool enable)
 {
-    return read_byte(addr) | static_cast<u16>(read_byte(addr+1) << 8);
+    cpu.set_idle_skip(enable);
 }
 
-void Invaders::write_byte(u16 addr, u8 data) 
-{  
-    if (addr < 0x2000 || addr >= 0x4000)
+// Only between frames. The last band ends with the frame, so it has no
+// event of its own.
+void Invaders::set_beam(bool enable)
+{
+    scheduler.remove(Event::Band);
+    if (!enable)
         return;
 
-    ram[addr-0x2000] = data;
+    for (int rows = BAND_ROWS; rows < VRAM_ROWS; rows += BAND_ROWS)
+        scheduler.add((rows * cycles_per_frame + VRAM_ROWS - 1) / VRAM_ROWS, Event::Band);
+}
 
-    //rom[addr] = data;
+bool Invaders::same_state(const Invaders& other) const
+{
+    return cpu.same_state(other.cpu) && ram == other.ram && frames == other.frames
+        && port1i == other.port1i && port2i == other.port2i && port2o == other.port2o
+        && port3o == other.port3o && port4lo == other.port4lo
+        && port4hi == other.port4hi && port5o == other.port5o;
 }
 
-void Invaders::write_word(u16 addr, u16 data) 
+void Invaders::save_state(SaveState& state) const
 {
-    write_byte(addr, data & 0xFF);
-    write_byte(addr+1, data >> 8);
+    state = {};
+    state.set_header();
+
+    cpu.save_state(state.cpu);
+    state.ram = ram;
+
+    state.io.frames = frames;
+    state.io.port1i = port1i;
+    state.io.port2i = port2i;
+    state.io.port2o = port2o;
+    state.io.port3o = port3o;
+    state.io.port4lo = port4lo;
+    state.io.port4hi = port4hi;
+    state.io.port5o = port5o;
 }
 
-u8 Invaders::read_port(u8 port) 
+// Leaves the machine untouched and returns false if state was not saved by
+// this version. The ROM is not part of the state; it has to be the same one.
+bool Invaders::load_state(const SaveState& state)
 {
-    u8 x;
+    if (!state.has_header())
+        return false;
 
-    switch (port)
+    // Only the VRAM rows that differ have to be drawn again
+    for (int row = 0; row < VRAM_ROWS; row++)
     {
-        case 1:
-            x = port1i | 0x08;
-            break;
-        case 2:
-            x = port2i;
-            break;
-        case 3:
-            x = static_cast<u8>(((((port4hi << 8) | port4lo) << port2o) >> 8));
-            break;
+        const int offset = 0x2400 - 0x2000 + row * VRAM_ROW_BYTES;
+        if (std::memcmp(&ram[offset], &state.ram[offset], VRAM_ROW_BYTES))
+            dirty_rows[row / 64] |= u64(1) << (row % 64);
     }
 
-    return x;
+    // States are taken between frames, so a frame left part way through
+    // with run_band() starts over
+    cpu.load_state(state.cpu);
+    ram = state.ram;
+    scheduler.restart();
+
+    frames = state.io.frames;
+    port1i = state.io.port1i;
+    port2i = state.io.port2i;
+    port2o = state.io.port2o;
+    port3o = state.io.port3o;
+    port4lo = state.io.port4lo;
+    port4hi = state.io.port4hi;
+    port5o = state.io.port5o;
+    return true;
 }
-    
-void Invaders::write_port(u8 port, u8 data)
-{ 
-    switch (port)
-    {
-        case 2:
-            port2o = data & 0x07;
-            break;
-        case 3:
-            // sound
-            break;
-        case 4:
-              port4lo = port4hi;
-              port4hi = data;
-              break;
-        case 5:
-            // sound
-            break;
-    }
+
+bool Invaders::save_state(const char* file_name) const
+{
+    SaveState state;
+    save_state(state);
+
+    FILE* file = fopen(file_name, "wb");
+    if (!file)
+        return false;
+
+    const bool written = fwrite(&state, sizeof(state), 1, file) == 1;
+    return fclose(file) == 0 && written;
 }
 
-void Invaders::load_rom(const char* file_name)
+bool Invaders::load_state(const char* file_name)
 {
-    std::ifstream file(file_name, std::ios::binary);
+    FILE* file = fopen(file_name, "rb");
     if (!file)
-        printf("Error");
+        return false;
+
+    SaveState state;
+    const bool read = fread(&state, sizeof(state), 1, file) == 1;
+    fclose(file);
 
-    file.unsetf(std::ios::skipws);
+    return read && load_state(state);
+}
+
+// The board ignores A15. Below that, ROM sits at 0x0000-0x1FFF, RAM and VRAM
+// at 0x2000-0x3FFF with a mirror at 0x6000-0x7FFF, and 0x4000-0x5FFF is
+// unmapped. ROM pages have no write pointer so writes to them are dropped,
+// and neither have VRAM pages, so that write_slow() sees every VRAM store.
+void Invaders::map_pages()
+{
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        const int addr = i << PAGE_BITS;
+        Page& page = pages[i];
 
-    std::copy(std::istream_iterator<u8>(file), std::istream_iterator<u8>(),
-            std::back_inserter(rom));
-    file.close();
+        if (addr < 0x2000) {
+            page.read = rom ? &rom->data[addr] : nullptr;
+            page.write = nullptr;
+        }
+        else if (addr < 0x4000 || addr >= 0x6000) {
+            page.read = &ram[addr & 0x1FFF];
+            page.write = (addr & 0x1FFF) < 0x400 ? &ram[addr & 0x1FFF] : nullptr;
+        }
+        else {
+            page.read = nullptr;
+            page.write = nullptr;
+        }
+    }
 }
 
 /*
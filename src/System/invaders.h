@@ -1,42 +1,104 @@
 #pragma once
 #include <memory>
-#include <SFML/Graphics.hpp>
+#include <cstring>
 #include "../8080/types.h"
 #include "../8080/cpu.h"
-#include "memory.h"
+#include "rom.h"
+#include "save_state.h"
+#include "scheduler.h"
+#include "screen.h"
 
-class Invaders : public Memory
+class Invaders
 {
     public:
     Invaders();
+    Invaders(const Invaders&) = delete;
+    Invaders& operator=(const Invaders&) = delete;
 
     public:
     void execute_instruction();
-    void handle_event(sf::Event& ev);
-    void render(sf::RenderWindow& window);
+    int run_band();
+    void set_port1(u8 bits, bool pressed);
+    void set_port1(u8 value);
+    u8 get_port1() const;
+    void capture_frame(Frame& frame);
+    void capture_rows(Frame& frame, int first_row, int end_row);
+    const u8* get_vram() const;
+    void mark_display_dirty();
 
     void load_rom(const char* file_name);
+    void set_rom(std::shared_ptr<const Rom> rom);
+    void set_block_cache(bool enable);
+    void set_jit(bool enable);
+    bool set_recompiled(bool enable);
+    void set_idle_skip(bool enable);
+    void set_beam(bool enable);
+    bool same_state(const Invaders& other) const;
+
+    void save_state(SaveState& state) const;
+    bool load_state(const SaveState& state);
+    bool save_state(const char* file_name) const;
+    bool load_state(const char* file_name);
+
+    u64 get_frames() const;
+    u64 get_instructions() const;
+    u64 get_total_cycles() const;
+    u32 ram_hash() const;
     //void load_test(const char* file_name);
 
-    u8 read_byte(u16 addr) const override;
-    u16 read_word(u16 addr) const override;
+    u8 read_byte(u16 addr) const;
+    u16 read_word(u16 addr) const;
 
-    void write_byte(u16 addr, u8 data) override;
-    void write_word(u16 addr, u16 data) override;
+    void write_byte(u16 addr, u8 data);
+    void write_word(u16 addr, u16 data);
 
-    u8 read_port(u8 port) override;
-    void write_port(u8 port, u8 data) override;
+    u8 read_port(u8 port);
+    void write_port(u8 port, u8 data);
+
+    private:
+    u8 read_slow(u16 addr) const;
+    void write_slow(u16 addr, u8 data);
+    void map_pages();
 
     private:
-    Cpu cpu;
+    Cpu<Invaders> cpu;
 
-    std::vector<u8> rom = {};
+    // One entry per 1 KB page of the 32 KB the board decodes, holding host
+    // pointers to the start of the page. A null pointer sends the access
+    // through read_slow/write_slow.
+    struct Page {
+        const u8* read;
+        u8* write;
+    };
+    static constexpr int PAGE_BITS = 10;
+    static constexpr u16 PAGE_MASK = (1 << PAGE_BITS) - 1;
+    std::array<Page, (0x8000 >> PAGE_BITS)> pages = {};
+
+    std::shared_ptr<const Rom> rom;
     std::array<u8, 0x2000> ram = {}; // ram + vram
     
-    static constexpr int WIDTH = 256;
-    static constexpr int HEIGHT = 224;
-    std::array<u8, WIDTH * HEIGHT * 4> display = {}; // RGBA 
+    // VRAM rows written since the last capture_frame(), one bit each. VRAM
+    // pages are left out of the write side of the page table so that every
+    // store to them goes through write_slow(), which sets these.
+    DirtyRows dirty_rows = {};
+
     static constexpr int cycles_per_interrupt = 2000000 / (60 * 2); // cycles per interrupt
+    static constexpr int cycles_per_frame = 2 * cycles_per_interrupt;
+
+    // RST 1 when the beam reaches mid-screen, RST 2 at VBlank, then the
+    // frame is done. The CPU counts cycles from the start of the frame.
+    // With set_beam() there is also a Band each time the beam has scanned
+    // another BAND_ROWS VRAM rows, the beam moving down them at an even
+    // pace over the frame.
+    enum class Event : u8 {
+        Band,
+        MidScreen,
+        VBlank,
+        FrameEnd,
+    };
+    static constexpr int BAND_ROWS = 32;
+    Scheduler<Event, 4 + VRAM_ROWS / BAND_ROWS> scheduler;
+    u64 frames = 0;
 
     u8 port1i  = 0;
     u8 port2i  = 0;
@@ -45,4 +107,114 @@ class Invaders : public Memory
     u8 port4lo = 0;
     u8 port4hi = 0;
     u8 port5o  = 0;
-};
\ No newline at end of file
+};
+
+inline u8 Invaders::read_byte(u16 addr) const 
+{
+    const u8* page = pages[(addr & 0x7FFF) >> PAGE_BITS].read;
+    if (page)
+        return page[addr & PAGE_MASK];
+
+    return read_slow(addr);
+}
+
+inline u16 Invaders::read_word(u16 addr) const 
+{
+    const u8* page = pages[(addr & 0x7FFF) >> PAGE_BITS].read;
+    if (page && (addr & PAGE_MASK) != PAGE_MASK) {
+        u16 data; // little-endian host, same byte order as the 8080
+        std::memcpy(&data, page + (addr & PAGE_MASK), sizeof(data));
+        return data;
+    }
+
+    return read_byte(addr) | static_cast<u16>(read_byte(addr+1) << 8);
+}
+
+inline void Invaders::write_byte(u16 addr, u8 data) 
+{  
+    u8* page = pages[(addr & 0x7FFF) >> PAGE_BITS].write;
+    if (page)
+        page[addr & PAGE_MASK] = data;
+    else
+        write_slow(addr, data);
+}
+
+inline void Invaders::write_word(u16 addr, u16 data) 
+{
+    u8* page = pages[(addr & 0x7FFF) >> PAGE_BITS].write;
+    if (page && (addr & PAGE_MASK) != PAGE_MASK) {
+        std::memcpy(page + (addr & PAGE_MASK), &data, sizeof(data));
+        return;
+    }
+
+    write_byte(addr, data & 0xFF);
+    write_byte(addr+1, data >> 8);
+}
+
+// Only 0x4000-0x5FFF reaches here, where nothing is mapped
+inline u8 Invaders::read_slow(u16) const
+{
+    return 0xFF;
+}
+
+// Only VRAM writes reach here with A13 set; ROM and 0x4000-0x5FFF ignore them
+inline void Invaders::write_slow(u16 addr, u8 data)
+{
+    if (!(addr & 0x2000))
+        return;
+
+    const int offset = addr & 0x1FFF;
+    if (ram[offset] == data)
+        return;
+
+    ram[offset] = data;
+
+    if (offset >= 0x400) {
+        const int row = (offset - 0x400) / VRAM_ROW_BYTES;
+        dirty_rows[row / 64] |= u64(1) << (row % 64);
+    }
+}
+
+inline u8 Invaders::read_port(u8 port) 
+{
+    u8 x;
+
+    switch (port)
+    {
+        case 1:
+            x = port1i | 0x08;
+            break;
+        case 2:
+            x = port2i;
+            break;
+        case 3:
+            x = static_cast<u8>(((((port4hi << 8) | port4lo) << port2o) >> 8));
+            break;
+        default:
+            // Unknown ports read as 0, like Batch::Lane::read_port
+            x = 0;
+            break;
+    }
+
+    return x;
+}
+    
+inline void Invaders::write_port(u8 port, u8 data)
+{ 
+    switch (port)
+    {
+        case 2:
+            port2o = data & 0x07;
+            break;
+        case 3:
+            // sound
+            break;
+        case 4:
+              port4lo = port4hi;
+              port4hi = data;
+              break;
+        case 5:
+            // sound
+            break;
+    }
+}
\ No newline at end of file
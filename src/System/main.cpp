@@ -1,30 +1,353 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
 #include "SFML/Graphics.hpp"
+#include "histogram.h"
 #include "invaders.h"
+#include "movie.h"
+#include "pacer.h"
+#include "presenter.h"
+#include "rewind.h"
+#include "spsc_queue.h"
+#include "triple_buffer.h"
 
+// The machine runs on its own thread at 60 frames a second, whatever the
+// window is doing. Finished frames go to the window through a triple buffer,
+// which always holds the newest one, and key presses come back as port 1
+// bit changes through a queue. Neither side ever waits for the other.
+// Every frame is also recorded for rewinding, which runs while R is held.
+// With run-ahead, each frame shown is run_ahead frames into the future with
+// the keys as they are now, after which the machine goes back to the real
+// present, so key presses show up that many frames sooner. With beam racing
+// a frame is run band by band at the pace the monitor's beam scans it, and
+// each band goes to the window as soon as it is done, showing the rows below
+// it as they were the frame before, the way the monitor would. Tab toggles
+// fast forward, which runs frames back to back and shows the window one per
+// refresh, skipping however many the machine got through in between.
+// Both threads are paced by a Pacer, and how long each part of a frame took
+// is printed when the game exits.
 
+struct Options {
+    bool overlay = false;
+    size_t rewind_budget = Rewind::DEFAULT_BUDGET;
+    int run_ahead = 0;
+    bool beam = false;
+    const char* record = nullptr; // movie file
+};
+
+struct InputChange {
+    u8 bits;
+    bool pressed;
+};
+
+// Everything the two threads share
+struct Channels {
+    TripleBuffer<Frame> frames;
+    SpscQueue<InputChange, 64> input;
+    std::atomic<bool> rewinding{false};
+    std::atomic<bool> turbo{false};
+    std::atomic<double> speed{1.0}; // frames run per frame of real time
+    std::atomic<bool> running{true};
+};
+
+// Per-frame times. The emulation thread fills in the first two and the
+// window thread the others; they are read once both are done.
+struct Timings {
+    Histogram emulate;  // the frame and any frames run ahead
+    Histogram capture;  // VRAM out to the triple buffer
+    Histogram render;   // a new frame into the texture
+    Histogram present;  // drawing and display()
+};
+
+// Port 1 bits a key drives, 0 if none
+static u8 port1_bits(sf::Keyboard::Key key)
+{
+    switch (key)
+    {
+        case sf::Keyboard::Left:
+            return 0x20;
+        case sf::Keyboard::Right:
+            return 0x40;
+        case sf::Keyboard::Space:   // shooot
+            return 0x10;
+        case sf::Keyboard::C:       // credit
+            return 0x1;
+        case sf::Keyboard::Num1:    // 1p
+            return 0x4;
+        case sf::Keyboard::Num2:    // 2p
+            return 0x2;
+        default:
+            return 0;
+    }
+}
+
+static constexpr std::chrono::nanoseconds FRAME_TIME{1000000000 / 60};
+static constexpr std::chrono::milliseconds SPEED_PERIOD{250};
+
+static u64 ns_since(Pacer::Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Pacer::Clock::now() - start).count();
+}
+
+// Publishes the back buffer once the caller has filled it in. Whether the
+// last frame published gets taken is only known once the next one replaces
+// it, so pending holds the rows written since the newest frame the window is
+// known to have taken, and every frame carries them too.
+static void publish(TripleBuffer<Frame>& frames, DirtyRows& pending)
+{
+    Frame& frame = frames.back();
+    const DirtyRows written = frame.dirty;
+
+    for (size_t i = 0; i < pending.size(); i++)
+        frame.dirty[i] |= pending[i];
+
+    if (frames.publish()) {
+        for (size_t i = 0; i < pending.size(); i++)
+            pending[i] |= written[i];
+    }
+    else
+        pending = written;
+}
+
+// Runs the pacer's current frame band by band, each band going into image
+// and on to the window once the beam would have finished it
+static void race_beam(Invaders& invaders, const Pacer& pacer, Frame& image, TripleBuffer<Frame>& frames,
+                      DirtyRows& pending, Timings& timings)
+{
+    const Pacer::Clock::time_point start = pacer.get_tick_start();
+    u64 emulate = 0;
+    u64 capture = 0;
+
+    for (int first_row = 0; first_row < VRAM_ROWS;)
+    {
+        auto before = Pacer::Clock::now();
+        const int end_row = invaders.run_band();
+        emulate += ns_since(before);
+
+        pacer.sleep_until(start + FRAME_TIME * end_row / VRAM_ROWS);
+
+        before = Pacer::Clock::now();
+        invaders.capture_rows(image, first_row, end_row);
+        frames.back() = image;
+        publish(frames, pending);
+        capture += ns_since(before);
+        first_row = end_row;
+    }
+
+    timings.emulate.add(emulate);
+    timings.capture.add(capture);
+}
+
+static void emulate(Invaders& invaders, const Options& options, Rewind& history, Movie& movie,
+                    Channels& channels, Pacer& pacer, Timings& timings)
+{
+    auto shown = Pacer::Clock::now(); // when the window was last sent a frame
+    auto speed_start = shown;
+    int speed_frames = 0;
+    SaveState state;
+    u8 held = 0; // port 1 bits of the keys down right now
+    bool rewound = false; // whether the last pass rewound
+    DirtyRows pending = {};
+    Frame image = {}; // the screen as the beam has left it
+
+    while (channels.running.load(std::memory_order_relaxed))
+    {
+        InputChange change;
+        while (channels.input.pop(change)) {
+            held = change.pressed ? held | change.bits : held & ~change.bits;
+            invaders.set_port1(change.bits, change.pressed);
+        }
+
+        const bool rewinding = channels.rewinding.load(std::memory_order_relaxed);
+        const bool turbo = !rewinding && channels.turbo.load(std::memory_order_relaxed);
+        const auto now = Pacer::Clock::now();
+        const bool show = !turbo || now - shown >= FRAME_TIME;
+        bool ahead = false;
+        bool raced = false;
+
+        if (rewinding) {
+            // The newest state is the one the machine is in, so the first
+            // step back drops it. The keys go on as they are now, not as
+            // they were back then. The movie is cut back right away in case
+            // the window closes before the next frame is recorded.
+            if (!rewound)
+                history.pop(state);
+            if (history.pop(state) && invaders.load_state(state)) {
+                invaders.set_port1(held);
+                if (options.record)
+                    movie.truncate(invaders.get_frames());
+            }
+        }
+        else {
+            const u64 frame = invaders.get_frames();
+            const u8 port1 = invaders.get_port1();
+            if (options.beam && !turbo) {
+                race_beam(invaders, pacer, image, channels.frames, pending, timings);
+                raced = true;
+            }
+            else
+                invaders.execute_instruction();
+            invaders.save_state(state);
+            history.push(state);
+
+            if (options.record)
+                movie.record(frame, port1, invaders.ram_hash());
+
+            // Only the last frame ahead is captured
+            if (show) {
+                for (int i = 0; i < options.run_ahead; i++)
+                    invaders.execute_instruction();
+                ahead = options.run_ahead > 0;
+            }
+        }
+        rewound = rewinding;
+        if (!raced)
+            timings.emulate.add(ns_since(now));
+
+        // Frames not shown leave their rows dirty for the next one that is
+        if (show && !raced) {
+            const auto before = Pacer::Clock::now();
+            TripleBuffer<Frame>& frames = channels.frames;
+            Frame& frame = options.beam ? image : frames.back();
+            invaders.capture_frame(frame);
+            if (ahead)
+                invaders.load_state(state);
+            if (options.beam)
+                frames.back() = image;
+            publish(frames, pending);
+            timings.capture.add(ns_since(before));
+        }
+        if (show)
+            shown = now;
+
+        speed_frames++;
+        if (now - speed_start >= SPEED_PERIOD) {
+            const double seconds = std::chrono::duration<double>(now - speed_start).count();
+            channels.speed.store(speed_frames / seconds / 60, std::memory_order_relaxed);
+            speed_start = now;
+            speed_frames = 0;
+        }
+
+        // Fast forward carries on from now once it ends
+        if (turbo)
+            pacer.restart();
+        else
+            pacer.wait();
+    }
+}
+
+static void report(const char* name, const Histogram& histogram)
+{
+    printf("%-16s %9.1f %9.1f %9.1f\n", name, histogram.percentile(50) / 1e3,
+           histogram.percentile(99) / 1e3, histogram.get_max() / 1e3);
+}
+
+static void usage(const char* name)
+{
+    printf("usage: %s <rom> [--overlay] [--rewind MB] [--run-ahead N] [--beam] [--record FILE]\n", name);
+}
 
 int main(int argc, char** argv)
 {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Options options;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--overlay"))
+            options.overlay = true;
+        else if (!strcmp(argv[i], "--rewind") && i + 1 < argc)
+            options.rewind_budget = strtoull(argv[++i], nullptr, 10) << 20;
+        else if (!strcmp(argv[i], "--run-ahead") && i + 1 < argc)
+            options.run_ahead = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            options.record = argv[++i];
+        else if (!strcmp(argv[i], "--beam"))
+            options.beam = true;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Frames run ahead are shown whole
+    options.beam = options.beam && options.run_ahead == 0;
+
     Invaders invaders;
     invaders.load_rom(argv[1]);
+    invaders.set_beam(options.beam);
+    Rewind history(options.rewind_budget);
+    Movie movie;
 
     sf::RenderWindow window(sf::VideoMode(420,480), "spaceinvaders");
-    window.setFramerateLimit(60);
+    window.setKeyRepeatEnabled(false);
     window.setPosition(sf::Vector2i(500, 250));
     sf::Event event;
 
+    Presenter presenter(options.overlay);
+    Channels channels;
+    Timings timings;
+    Pacer pacer(60);
+    Pacer refresh(60);
+
+    std::thread emulation(emulate, std::ref(invaders), std::cref(options), std::ref(history),
+                          std::ref(movie), std::ref(channels), std::ref(pacer), std::ref(timings));
+
     while (window.isOpen())
     {
         while (window.pollEvent(event))
         {
             if (event.type == event.Closed)
                 window.close();
-           
-            invaders.handle_event(event);
+
+            if (event.type == sf::Event::KeyPressed || event.type == sf::Event::KeyReleased) {
+                const bool pressed = event.type == sf::Event::KeyPressed;
+                const u8 bits = port1_bits(event.key.code);
+                if (bits)
+                    channels.input.push({bits, pressed});
+                else if (event.key.code == sf::Keyboard::R)
+                    channels.rewinding = pressed;
+                else if (event.key.code == sf::Keyboard::Tab && pressed)
+                    channels.turbo = !channels.turbo;
+            }
+        }
+
+        presenter.set_speed(channels.turbo ? channels.speed.load(std::memory_order_relaxed) : 0);
+
+        auto before = Pacer::Clock::now();
+        if (const Frame* frame = channels.frames.take()) {
+            presenter.update(*frame);
+            timings.render.add(ns_since(before));
         }
 
-        invaders.execute_instruction();        
-        invaders.render(window);
+        before = Pacer::Clock::now();
+        presenter.draw(window);
+        timings.present.add(ns_since(before));
 
+        refresh.wait();
     }
-}
\ No newline at end of file
+
+    channels.running = false;
+    emulation.join();
+
+    printf("per frame, us          p50       p99       max\n");
+    report("emulate", timings.emulate);
+    report("capture", timings.capture);
+    report("render", timings.render);
+    report("present", timings.present);
+    report("emulation late", pacer.get_lateness());
+    report("window late", refresh.get_lateness());
+    printf("%.4f frames/s over the last %llu frames\n", pacer.get_rate(),
+           static_cast<unsigned long long>(pacer.get_ticks()));
+
+    if (options.record && !movie.save(options.record))
+        printf("cannot write %s\n", options.record);
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "movie.h"
+
+// Frames have to be recorded in order, but recording may go back to an
+// earlier frame (after rewinding), which drops everything from there on
+void Movie::record(u64 frame, u8 port1, u32 hash)
+{
+    truncate(frame);
+
+    if (port1 != port1_at(frame))
+        changes.push_back({static_cast<u32>(frame), port1, {}});
+
+    hashes.resize(frame);
+    hashes.push_back(hash);
+}
+
+void Movie::truncate(u64 frames)
+{
+    while (!changes.empty() && changes.back().frame >= frames)
+        changes.pop_back();
+
+    if (hashes.size() > frames)
+        hashes.resize(frames);
+}
+
+u8 Movie::port1_at(u64 frame) const
+{
+    const auto next = std::upper_bound(changes.begin(), changes.end(), frame,
+                                       [](u64 frame, const Change& change) {
+                                           return frame < change.frame;
+                                       });
+
+    return next == changes.begin() ? 0 : (next - 1)->port1;
+}
+
+// Frames past the end of the recording always pass
+bool Movie::check(u64 frame, u32 hash) const
+{
+    return frame >= hashes.size() || hashes[frame] == hash;
+}
+
+u64 Movie::get_frames() const
+{
+    return hashes.size();
+}
+
+bool Movie::save(const char* file_name) const
+{
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.frames = static_cast<u32>(hashes.size());
+    header.changes = static_cast<u32>(changes.size());
+
+    FILE* file = fopen(file_name, "wb");
+    if (!file)
+        return false;
+
+    const bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(changes.data(), sizeof(Change), changes.size(), file) == changes.size()
+        && fwrite(hashes.data(), sizeof(u32), hashes.size(), file) == hashes.size();
+
+    return fclose(file) == 0 && written;
+}
+
+// The counts in the header have to add up to the size of the file before
+// anything is allocated for them, and the changes have to be in frame order
+// for port1_at()
+bool Movie::load(const char* file_name)
+{
+    FILE* file = fopen(file_name, "rb");
+    if (!file)
+        return false;
+
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    Header header;
+    bool read = fread(&header, sizeof(header), 1, file) == 1
+        && !std::memcmp(header.magic, MAGIC, sizeof(header.magic))
+        && header.version == VERSION
+        && size >= 0
+        && static_cast<u64>(size) == sizeof(Header) + u64(header.changes) * sizeof(Change)
+                                     + u64(header.frames) * sizeof(u32);
+
+    if (read) {
+        changes.resize(header.changes);
+        hashes.resize(header.frames);
+        read = fread(changes.data(), sizeof(Change), changes.size(), file) == changes.size()
+            && fread(hashes.data(), sizeof(u32), hashes.size(), file) == hashes.size()
+            && std::adjacent_find(changes.begin(), changes.end(),
+                                  [](const Change& a, const Change& b) {
+                                      return a.frame >= b.frame;
+                                  }) == changes.end();
+    }
+
+    fclose(file);
+
+    if (!read) {
+        changes.clear();
+        hashes.clear();
+    }
+    return read;
+}
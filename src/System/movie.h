@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include "../8080/types.h"
+
+// Input recording that replays a run exactly: the value of port 1 from
+// every frame on which it changed, plus a hash of RAM after every frame to
+// check that the replay did not drift. Frame n is the one run after n
+// frames have been run since power-on; its input is set before it starts.
+//
+// The file is a header, the changes, then the hashes, all fixed-size
+// fields in host byte order. Frame numbers are stored in 32 bits, over two
+// years of play.
+class Movie
+{
+    public:
+    void record(u64 frame, u8 port1, u32 hash);
+    void truncate(u64 frames);
+
+    u8 port1_at(u64 frame) const;
+    bool check(u64 frame, u32 hash) const;
+    u64 get_frames() const;
+
+    bool save(const char* file_name) const;
+    bool load(const char* file_name);
+
+    private:
+    static constexpr char MAGIC[4] = {'S', 'I', 'M', 'V'};
+    static constexpr u32 VERSION = 1;
+
+    struct Header {
+        char magic[4];
+        u32 version;
+        u32 frames;
+        u32 changes;
+    };
+
+    struct Change {
+        u32 frame;
+        u8 port1;
+        u8 reserved[3];
+    };
+
+    std::vector<Change> changes;
+    std::vector<u32> hashes; // one per frame
+};
@@ -0,0 +1,82 @@
+#include <thread>
+#include "pacer.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <ctime>
+#endif
+
+Pacer::Pacer(int _rate)
+    :
+    rate{_rate},
+    start{Clock::now()}
+{
+}
+
+void Pacer::wait()
+{
+    tick++;
+
+    const Clock::time_point deadline = due(tick);
+    if (Clock::now() - deadline > STALL_TICKS * (due(1) - due(0))) {
+        restart();
+        return;
+    }
+
+    sleep_until(deadline);
+    lateness.add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - deadline).count());
+}
+
+void Pacer::restart()
+{
+    start = Clock::now();
+    tick = 0;
+}
+
+// steady_clock is CLOCK_MONOTONIC with both libstdc++ and libc++ on Linux,
+// so its time points go to clock_nanosleep as they are
+void Pacer::sleep_until(Clock::time_point time) const
+{
+    const Clock::time_point wake = time - SPIN;
+
+#if defined(__linux__)
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wake.time_since_epoch()).count();
+    if (ns > 0) {
+        timespec until;
+        until.tv_sec = ns / 1000000000;
+        until.tv_nsec = ns % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR) {}
+    }
+#else
+    std::this_thread::sleep_until(wake);
+#endif
+
+    while (Clock::now() < time)
+        std::this_thread::yield();
+}
+
+Pacer::Clock::time_point Pacer::get_tick_start() const
+{
+    return due(tick);
+}
+
+u64 Pacer::get_ticks() const
+{
+    return tick;
+}
+
+double Pacer::get_rate() const
+{
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return seconds > 0 ? tick / seconds : 0;
+}
+
+const Histogram& Pacer::get_lateness() const
+{
+    return lateness;
+}
+
+Pacer::Clock::time_point Pacer::due(u64 n) const
+{
+    return start + std::chrono::nanoseconds(n * 1000000000 / rate);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <chrono>
+#include "../8080/types.h"
+#include "histogram.h"
+
+// Runs a loop at a fixed rate. Tick n is due at start + n * 1 s / rate,
+// worked out from n every time, so rounding never builds up and the rate
+// holds exactly over any run. Waits sleep to an absolute deadline with
+// clock_nanosleep on Linux (plain sleep_until elsewhere) until SPIN before
+// it and spin the rest of the way, and how late each tick really was goes
+// into a histogram. A tick more than STALL_TICKS late (suspend, debugger)
+// starts the count over from now instead of racing to catch up.
+class Pacer
+{
+    public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::microseconds SPIN{200};
+    static constexpr int STALL_TICKS = 4;
+
+    explicit Pacer(int rate);
+
+    void wait();
+    void restart();
+    void sleep_until(Clock::time_point time) const;
+
+    // When the current tick was due to start
+    Clock::time_point get_tick_start() const;
+
+    // Both since the last restart
+    u64 get_ticks() const;
+    double get_rate() const;
+    const Histogram& get_lateness() const;
+
+    private:
+    Clock::time_point due(u64 tick) const;
+
+    const int rate;
+    Clock::time_point start;
+    u64 tick = 0;
+    Histogram lateness;
+};
@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cstring>
+#include "presenter.h"
+
+// 3x5 pixel glyphs, one octal digit per row from the top with the left pixel
+// in its high bit
+static u16 glyph(char c)
+{
+    static constexpr u16 DIGITS[] = {
+        075557, 026227, 071747, 071717, 055711,
+        074717, 074757, 071111, 075757, 075717
+    };
+
+    if (c >= '0' && c <= '9')
+        return DIGITS[c - '0'];
+
+    switch (c)
+    {
+        case '.': return 000002;
+        case 'x': return 005250;
+        default:  return 0;
+    }
+}
+
+Presenter::Presenter(bool _colour_overlay)
+    :
+    colour_overlay{_colour_overlay}
+{
+    texture.create(SCREEN_WIDTH, SCREEN_HEIGHT);
+    sprite.setTexture(texture, true);
+    sprite.setScale(1.8f,1.8f);
+}
+
+void Presenter::update(const Frame& frame)
+{
+    screen.update(frame, colour_overlay);
+
+    for (int i = 0; i < screen.get_strip_count(); i++)
+    {
+        const Screen::Strip& strip = screen.get_strip(i);
+        texture.update(reinterpret_cast<const u8*>(strip.pixels),
+                       strip.width, SCREEN_HEIGHT, strip.x, 0);
+    }
+}
+
+void Presenter::set_speed(double _speed)
+{
+    speed = _speed;
+}
+
+void Presenter::draw(sf::RenderWindow& window)
+{
+    window.clear();
+    window.draw(sprite);
+    if (speed > 0)
+        draw_speed(window);
+    window.display();
+}
+
+// One rectangle per lit glyph pixel over a dark box: a few dozen rectangles
+// and no font file to ship
+void Presenter::draw_speed(sf::RenderWindow& window)
+{
+    static constexpr float PIXEL = 3.0f;
+
+    char text[16];
+    snprintf(text, sizeof(text), "%.1fx", speed);
+    const int length = static_cast<int>(strlen(text));
+
+    sf::RectangleShape box(sf::Vector2f((length * 4 + 1) * PIXEL, 7 * PIXEL));
+    box.setFillColor(sf::Color(0, 0, 0, 160));
+    window.draw(box);
+
+    sf::RectangleShape pixel(sf::Vector2f(PIXEL, PIXEL));
+    pixel.setFillColor(sf::Color(255, 255, 0));
+
+    for (int i = 0; i < length; i++)
+    {
+        const u16 bits = glyph(text[i]);
+        for (int y = 0; y < 5; y++)
+            for (int x = 0; x < 3; x++)
+                if (bits >> ((4 - y) * 3 + 2 - x) & 1) {
+                    pixel.setPosition((1 + i * 4 + x) * PIXEL, (1 + y) * PIXEL);
+                    window.draw(pixel);
+                }
+    }
+}
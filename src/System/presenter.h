@@ -0,0 +1,27 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include "screen.h"
+
+// Shows frames in a window. Keeps one texture and uploads only the strips
+// of each frame that changed. A speed set above 0 is drawn in the top left
+// corner as a multiple of real time.
+class Presenter
+{
+    public:
+    explicit Presenter(bool colour_overlay);
+    Presenter(const Presenter&) = delete;
+    Presenter& operator=(const Presenter&) = delete;
+
+    void update(const Frame& frame);
+    void set_speed(double speed);
+    void draw(sf::RenderWindow& window);
+
+    private:
+    void draw_speed(sf::RenderWindow& window);
+
+    Screen screen;
+    sf::Texture texture;
+    sf::Sprite sprite;
+    bool colour_overlay;
+    double speed = 0;
+};
@@ -0,0 +1,195 @@
+#include <cstring>
+#include "rewind.h"
+
+// States are compared a u64 word at a time. An encoded state is a series of
+// runs: a u16 count of unchanged words, a u16 count of changed words, then
+// the changed words XORed with the reference. Unchanged words at the end
+// are left out.
+static constexpr size_t WORDS = sizeof(SaveState) / 8;
+static constexpr size_t MAX_ENCODED = sizeof(SaveState) + 4 * (WORDS / 2 + 1);
+static constexpr size_t CHUNK = 64;
+
+static_assert(sizeof(SaveState) % 8 == 0, "SaveState is compared in words");
+static_assert(WORDS <= 0xFFFF, "run lengths are u16");
+
+static inline u64 load64(const u8* p)
+{
+    u64 data;
+    std::memcpy(&data, p, sizeof(data));
+    return data;
+}
+
+static inline void store64(u8* p, u64 data)
+{
+    std::memcpy(p, &data, sizeof(data));
+}
+
+static inline void store16(u8* p, u16 data)
+{
+    std::memcpy(p, &data, sizeof(data));
+}
+
+static size_t encode(const u8* state, const u8* reference, u8* out)
+{
+    u8* const start = out;
+    size_t word = 0;
+
+    while (word < WORDS)
+    {
+        // Unchanged runs are most of a state; memcmp skips them CHUNK
+        // bytes at a time with vector compares
+        const size_t unchanged = word;
+        while (word + CHUNK / 8 <= WORDS && !std::memcmp(state + word * 8, reference + word * 8, CHUNK))
+            word += CHUNK / 8;
+        while (word < WORDS && load64(state + word * 8) == load64(reference + word * 8))
+            word++;
+
+        if (word == WORDS)
+            break;
+
+        const size_t changed = word;
+        while (word < WORDS && load64(state + word * 8) != load64(reference + word * 8))
+            word++;
+
+        store16(out, changed - unchanged);
+        store16(out + 2, word - changed);
+        out += 4;
+
+        for (size_t i = changed; i < word; i++, out += 8)
+            store64(out, load64(state + i * 8) ^ load64(reference + i * 8));
+    }
+
+    return out - start;
+}
+
+// XORs an encoded state into state
+static void decode(const u8* in, size_t size, u8* state)
+{
+    const u8* const end = in + size;
+    size_t word = 0;
+
+    while (in < end)
+    {
+        u16 unchanged, changed;
+        std::memcpy(&unchanged, in, sizeof(unchanged));
+        std::memcpy(&changed, in + 2, sizeof(changed));
+        in += 4;
+        word += unchanged;
+
+        for (size_t i = 0; i < changed; i++, word++, in += 8)
+            store64(state + word * 8, load64(state + word * 8) ^ load64(in));
+    }
+}
+
+Rewind::Rewind(size_t budget)
+    :
+    buffer(budget)
+{
+}
+
+void Rewind::push(const SaveState& state)
+{
+    if (buffer.size() < MAX_ENCODED)
+        return;
+
+    size_t offset = 0;
+    if (!entries.empty())
+        offset = entries.back().offset + entries.back().size;
+
+    // Too little room before the end of the buffer: drop whatever is still
+    // there and wrap around
+    if (offset + MAX_ENCODED > buffer.size()) {
+        while (!entries.empty() && entries.front().offset >= offset)
+            drop_oldest();
+        offset = 0;
+    }
+
+    while (!entries.empty() && entries.front().offset >= offset
+           && entries.front().offset < offset + MAX_ENCODED)
+        drop_oldest();
+
+    const bool is_keyframe = entries.empty() || since_keyframe >= KEYFRAME_INTERVAL;
+    const u8* raw = reinterpret_cast<const u8*>(&state);
+    u8* out = buffer.data() + offset;
+    size_t size;
+
+    if (is_keyframe) {
+        static const SaveState zero = {};
+        size = encode(raw, reinterpret_cast<const u8*>(&zero), out);
+        keyframe = state;
+        since_keyframe = 0;
+    }
+    else
+        size = encode(raw, reinterpret_cast<const u8*>(&keyframe), out);
+
+    entries.push_back({offset, size, is_keyframe});
+    bytes += size;
+    since_keyframe++;
+}
+
+// Takes the newest state off the history
+bool Rewind::pop(SaveState& state)
+{
+    if (entries.empty())
+        return false;
+
+    const Entry entry = entries.back();
+    entries.pop_back();
+    bytes -= entry.size;
+
+    if (entry.keyframe) {
+        state = keyframe;
+        load_keyframe();
+    }
+    else {
+        state = keyframe;
+        decode(buffer.data() + entry.offset, entry.size, reinterpret_cast<u8*>(&state));
+        since_keyframe--;
+    }
+
+    return true;
+}
+
+void Rewind::clear()
+{
+    entries.clear();
+    bytes = 0;
+    since_keyframe = 0;
+}
+
+size_t Rewind::get_count() const
+{
+    return entries.size();
+}
+
+size_t Rewind::get_bytes() const
+{
+    return bytes;
+}
+
+// Removes the oldest keyframe and every delta against it
+void Rewind::drop_oldest()
+{
+    do {
+        bytes -= entries.front().size;
+        entries.pop_front();
+    } while (!entries.empty() && !entries.front().keyframe);
+}
+
+// Decodes the newest keyframe left after the one in keyframe was popped
+void Rewind::load_keyframe()
+{
+    size_t index = entries.size();
+    while (index > 0 && !entries[index - 1].keyframe)
+        index--;
+
+    since_keyframe = entries.size() - index + 1;
+    if (index == 0) {
+        since_keyframe = 0;
+        return;
+    }
+
+    const Entry& entry = entries[index - 1];
+    keyframe = {};
+    decode(buffer.data() + entry.offset, entry.size, reinterpret_cast<u8*>(&keyframe));
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include "save_state.h"
+
+// History of save states, one per frame, in a ring of a fixed number of
+// bytes. Every KEYFRAME_INTERVAL-th state is a keyframe; the ones in between
+// are stored as their XOR against the keyframe before them, which is almost
+// all zeros, with the runs of unchanged words left out. When the ring is
+// full the oldest keyframe goes, together with the states that depend on it.
+// Stepping back decodes at most one keyframe and one delta.
+class Rewind
+{
+    public:
+    static constexpr size_t DEFAULT_BUDGET = 16 << 20;
+    static constexpr size_t KEYFRAME_INTERVAL = 10;
+
+    explicit Rewind(size_t budget = DEFAULT_BUDGET);
+
+    void push(const SaveState& state);
+    bool pop(SaveState& state);
+    void clear();
+
+    size_t get_count() const;
+    size_t get_bytes() const;
+
+    private:
+    struct Entry {
+        size_t offset;  // in buffer
+        size_t size;
+        bool keyframe;
+    };
+
+    void drop_oldest();
+    void load_keyframe();
+
+    std::vector<u8> buffer;
+    std::deque<Entry> entries;
+    size_t bytes = 0;               // encoded bytes in use
+    SaveState keyframe = {};        // decoded newest keyframe
+    size_t since_keyframe = 0;      // entries from it on
+};
@@ -0,0 +1,26 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "rom.h"
+
+// Shorter files are padded with 0xFF, longer ones cut off
+std::shared_ptr<const Rom> Rom::load(const char* file_name)
+{
+    std::ifstream file(file_name, std::ios::binary);
+    if (!file)
+        printf("Error");
+
+    file.unsetf(std::ios::skipws);
+
+    std::vector<u8> bytes;
+    std::copy(std::istream_iterator<u8>(file), std::istream_iterator<u8>(),
+            std::back_inserter(bytes));
+    bytes.resize(SIZE, 0xFF);
+
+    auto rom = std::make_shared<Rom>();
+    std::copy(bytes.begin(), bytes.end(), rom->data.begin());
+    rom->code = CodeCache::build(rom->data.data(), SIZE);
+    return rom;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <array>
+#include <memory>
+#include "../8080/cpu.h"
+
+// The program ROM at 0x0000-0x1FFF. It never changes once loaded, so every
+// machine running the same game can share one copy, and the blocks decoded
+// from it with it.
+struct Rom {
+    static constexpr int SIZE = 0x2000;
+
+    std::array<u8, SIZE> data;
+    CodeCache code;
+
+    static std::shared_ptr<const Rom> load(const char* file_name);
+};
@@ -0,0 +1,135 @@
+#include "runner.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+Runner::Runner(const char* rom, int _instance_count, int _thread_count)
+    :
+    instance_count{_instance_count},
+    thread_count{_thread_count},
+    instances{new Instance[_instance_count]},
+    slices{new Slice[_thread_count]}
+{
+    const std::shared_ptr<const Rom> image = Rom::load(rom);
+    for (int i = 0; i < instance_count; i++)
+        instances[i].machine.set_rom(image);
+
+    for (int w = 0; w < thread_count; w++)
+    {
+        slices[w].begin = static_cast<long long>(instance_count) * w / thread_count;
+        slices[w].end = static_cast<long long>(instance_count) * (w + 1) / thread_count;
+    }
+
+    for (int w = 0; w < thread_count; w++)
+        threads.emplace_back(&Runner::work, this, w);
+}
+
+Runner::~Runner()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start.notify_all();
+
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+// Runs every instance for frames frames and returns when all are done
+void Runner::run(int frames)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (int w = 0; w < thread_count; w++)
+        slices[w].next.store(slices[w].begin, std::memory_order_relaxed);
+
+    frames_per_round = frames;
+    busy = thread_count;
+    round++;
+    start.notify_all();
+
+    done.wait(lock, [this] { return busy == 0; });
+}
+
+void Runner::set_port1(int instance, u8 value)
+{
+    instances[instance].machine.set_port1(value);
+}
+
+const Invaders& Runner::get_machine(int instance) const
+{
+    return instances[instance].machine;
+}
+
+int Runner::get_instance_count() const
+{
+    return instance_count;
+}
+
+u64 Runner::get_frames() const
+{
+    u64 frames = 0;
+    for (int i = 0; i < instance_count; i++)
+        frames += instances[i].machine.get_frames();
+    return frames;
+}
+
+u64 Runner::get_instructions() const
+{
+    u64 instructions = 0;
+    for (int i = 0; i < instance_count; i++)
+        instructions += instances[i].machine.get_instructions();
+    return instructions;
+}
+
+void Runner::work(int worker)
+{
+#if defined(__linux__)
+    const unsigned cores = std::thread::hardware_concurrency();
+    if (cores) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker % cores, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+
+    u64 seen = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start.wait(lock, [&] { return stopping || round != seen; });
+            if (stopping)
+                return;
+            seen = round;
+        }
+
+        run_slices(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+            done.notify_one();
+    }
+}
+
+// Own slice first, then whatever the others have not started yet
+void Runner::run_slices(int worker)
+{
+    for (int k = 0; k < thread_count; k++)
+    {
+        Slice& slice = slices[(worker + k) % thread_count];
+
+        for (int i = slice.next.fetch_add(1, std::memory_order_relaxed); i < slice.end;
+             i = slice.next.fetch_add(1, std::memory_order_relaxed))
+        {
+            Invaders& machine = instances[i].machine;
+            for (int f = 0; f < frames_per_round; f++)
+                machine.execute_instruction();
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "invaders.h"
+
+// Runs many independent machines on a fixed set of worker threads. Every
+// worker owns a contiguous slice of the instances and runs those first, so
+// a machine normally stays on one core and in its caches; a worker that
+// runs out takes what is left of the other slices. Instances and slice
+// counters sit on cache lines of their own, and the workers share nothing
+// else while a round runs but the read-only ROM.
+class Runner
+{
+    public:
+    Runner(const char* rom, int instance_count, int thread_count);
+    ~Runner();
+    Runner(const Runner&) = delete;
+    Runner& operator=(const Runner&) = delete;
+
+    void run(int frames);
+
+    // Only between rounds
+    void set_port1(int instance, u8 value);
+    const Invaders& get_machine(int instance) const;
+
+    int get_instance_count() const;
+    u64 get_frames() const;
+    u64 get_instructions() const;
+
+    private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Instance {
+        Invaders machine;
+    };
+
+    struct alignas(CACHE_LINE) Slice {
+        std::atomic<int> next{0};
+        int begin = 0;
+        int end = 0;
+    };
+
+    void work(int worker);
+    void run_slices(int worker);
+
+    int instance_count;
+    int thread_count;
+    std::unique_ptr<Instance[]> instances;
+    std::unique_ptr<Slice[]> slices;
+    std::vector<std::thread> threads;
+
+    // Round handshake; only touched at the start and end of a round
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    u64 round = 0;
+    int frames_per_round = 0;
+    int busy = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "runner.h"
+
+// Multi-instance throughput: runs the same number of machines on 1, 2, 4,
+// ... up to --threads workers and reports aggregate frames/s for each, with
+// the speedup over one worker and the scaling efficiency per core.
+
+static void usage(const char* name)
+{
+    printf("usage: %s <rom> [--instances M] [--threads T] [--frames N] [--round F]\n", name);
+}
+
+struct Result {
+    double fps;
+    double ips;
+};
+
+static Result measure(const char* rom, int instances, int threads, int frames, int round)
+{
+    Runner runner(rom, instances, threads);
+    runner.run(round); // warm up: page faults, caches
+
+    const u64 first_frames = runner.get_frames();
+    const u64 first_instructions = runner.get_instructions();
+    const auto start = std::chrono::steady_clock::now();
+
+    for (int done = 0; done < frames; done += round)
+        runner.run(round);
+
+    const auto end = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    return {(runner.get_frames() - first_frames) / seconds,
+            (runner.get_instructions() - first_instructions) / seconds};
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    int threads = cores;
+    int instances = 0;
+    int frames = 600;
+    int round = 10;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--instances") && i + 1 < argc)
+            instances = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--round") && i + 1 < argc)
+            round = atoi(argv[++i]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (threads < 1 || frames < 1 || round < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (instances < 1)
+        instances = 4 * threads;
+
+    printf("%d instances, %d frames each in rounds of %d, %d cores\n\n",
+           instances, frames, round, cores);
+    printf("threads    frames/s    instr/s   speedup  efficiency\n");
+
+    double base = 0;
+
+    for (int t = 1; ; t = std::min(t * 2, threads))
+    {
+        const Result result = measure(argv[1], instances, t, frames, round);
+        if (t == 1)
+            base = result.fps;
+
+        const double speedup = result.fps / base;
+        printf("%7d  %10.0f  %8.1f M  %7.2fx  %9.1f%%\n",
+               t, result.fps, result.ips / 1e6, speedup, 100 * speedup / t);
+
+        if (t == threads)
+            break;
+    }
+}
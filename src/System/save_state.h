@@ -0,0 +1,55 @@
+#pragma once
+#include <array>
+#include <cstring>
+#include "../8080/cpu.h"
+
+// Whole machine at a frame boundary: header, CPU, RAM and VRAM
+// (0x2000-0x3FFF), then the I/O ports. Every field has a fixed size and
+// host byte order, so a snapshot is copied in and out with a few memcpys
+// and written to a file as is. VERSION goes up whenever the layout changes.
+struct SaveState {
+    static constexpr char MAGIC[4] = {'S', 'I', 'S', 'V'};
+    static constexpr u32 VERSION = 1;
+
+    struct Header {
+        char magic[4];
+        u32 version;
+        u32 size;           // sizeof(SaveState)
+        u32 reserved;
+    };
+
+    struct Io {
+        u64 frames;
+        u8 port1i;
+        u8 port2i;
+        u8 port2o;
+        u8 port3o;
+        u8 port4lo;
+        u8 port4hi;
+        u8 port5o;
+        u8 reserved;
+    };
+
+    Header header;
+    CpuState cpu;
+    std::array<u8, 0x2000> ram;
+    Io io;
+
+    // Stamps the header of a state being saved by this version
+    void set_header()
+    {
+        header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.size = sizeof(SaveState);
+    }
+
+    // Whether the state was saved by this version
+    bool has_header() const
+    {
+        return !std::memcmp(header.magic, MAGIC, sizeof(header.magic))
+            && header.version == VERSION && header.size == sizeof(SaveState);
+    }
+};
+
+static_assert(sizeof(SaveState) == 16 + sizeof(CpuState) + 0x2000 + 16, "SaveState layout changed");
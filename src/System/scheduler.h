@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include "../8080/types.h"
+
+// Timed events that come round at the same cycle of every frame, counted
+// from the start of the frame and kept sorted. The machine runs the CPU
+// straight to next().cycle, handles next().event and calls advance(), so
+// the run loop only ever compares against one deadline and a device with
+// events of its own adds nothing per instruction. Events at the same cycle
+// fire in the order they were added. add() and remove() are only for
+// between frames.
+template <typename Event, int CAPACITY>
+class Scheduler
+{
+    public:
+    struct Entry {
+        int cycle;
+        Event event;
+    };
+
+    void add(int cycle, Event event)
+    {
+        int i = count++;
+        for (; i > 0 && entries[i - 1].cycle > cycle; i--)
+            entries[i] = entries[i - 1];
+        entries[i] = {cycle, event};
+    }
+
+    // Drops every entry for event
+    void remove(Event event)
+    {
+        int kept = 0;
+        for (int i = 0; i < count; i++)
+            if (entries[i].event != event)
+                entries[kept++] = entries[i];
+        count = kept;
+    }
+
+    const Entry& next() const
+    {
+        return entries[cursor];
+    }
+
+    void restart()
+    {
+        cursor = 0;
+    }
+
+    // Returns false once the frame's last event is done, leaving the first
+    // one next
+    bool advance()
+    {
+        if (++cursor < count)
+            return true;
+
+        cursor = 0;
+        return false;
+    }
+
+    private:
+    std::array<Entry, CAPACITY> entries = {};
+    u8 count = 0;
+    u8 cursor = 0;
+};
@@ -0,0 +1,185 @@
+#include <array>
+#include "screen.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// AVX2 is picked at run time, so default builds get it on CPUs that have it
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SCREEN_AVX2 1
+#else
+#define SCREEN_AVX2 0
+#endif
+
+static constexpr int COLUMN_GROUPS = SCREEN_WIDTH / 8;
+
+static constexpr u32 rgba(u8 r, u8 g, u8 b)
+{
+    return r | g << 8 | b << 16 | 0xFFu << 24;
+}
+
+static constexpr u32 WHITE = rgba(0xFF, 0xFF, 0xFF);
+static constexpr u32 RED   = rgba(0xFF, 0x20, 0x20);
+static constexpr u32 GREEN = rgba(0x20, 0xFF, 0x20);
+
+// Colour of the overlay strips for every screen row and group of 8 columns:
+// red across the top below the scores, green above the bases, and green
+// over the reserve ships at the bottom left
+static constexpr std::array<u32, SCREEN_HEIGHT * COLUMN_GROUPS> OVERLAY = [] {
+    std::array<u32, SCREEN_HEIGHT * COLUMN_GROUPS> table = {};
+    for (int y = 0; y < SCREEN_HEIGHT; y++)
+        for (int group = 0; group < COLUMN_GROUPS; group++)
+        {
+            u32 colour = WHITE;
+            if (y >= 32 && y < 64)
+                colour = RED;
+            else if (y >= 184 && y < 240)
+                colour = GREEN;
+            else if (y >= 240 && group >= 2 && group < 17)
+                colour = GREEN;
+
+            table[y * COLUMN_GROUPS + group] = colour;
+        }
+    return table;
+}();
+
+#if SCREEN_AVX2
+__attribute__((target("avx2")))
+static void expand_avx2(const u8* vram, u32* pixels, int stride, int first_row, int end_row, const u32* overlay)
+{
+    for (int c = 0; c < VRAM_ROW_BYTES; c++)
+        for (int r = first_row; r < end_row; r += 8)
+        {
+            const u8* src = vram + r * VRAM_ROW_BYTES + c;
+            const __m256i bytes = _mm256_set_epi32(src[7 * VRAM_ROW_BYTES], src[6 * VRAM_ROW_BYTES],
+                                                   src[5 * VRAM_ROW_BYTES], src[4 * VRAM_ROW_BYTES],
+                                                   src[3 * VRAM_ROW_BYTES], src[2 * VRAM_ROW_BYTES],
+                                                   src[1 * VRAM_ROW_BYTES], src[0]);
+
+            for (int bit = 0; bit < 8; bit++)
+            {
+                const int y = SCREEN_HEIGHT - 1 - (c * 8 + bit);
+                const __m256i mask = _mm256_set1_epi32(1 << bit);
+                const __m256i lit = _mm256_cmpeq_epi32(_mm256_and_si256(bytes, mask), mask);
+                const __m256i colour = _mm256_set1_epi32(overlay ? overlay[y * COLUMN_GROUPS + r / 8] : WHITE);
+
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + y * stride + r - first_row),
+                                    _mm256_and_si256(lit, colour));
+            }
+        }
+}
+#endif
+
+#if defined(__SSE2__)
+// Four VRAM rows at a time: bit b of each row's byte goes to one lane of the
+// same screen row
+static void expand_sse2(const u8* vram, u32* pixels, int stride, int first_row, int end_row, const u32* overlay)
+{
+    for (int c = 0; c < VRAM_ROW_BYTES; c++)
+        for (int r = first_row; r < end_row; r += 4)
+        {
+            const u8* src = vram + r * VRAM_ROW_BYTES + c;
+            const __m128i bytes = _mm_set_epi32(src[3 * VRAM_ROW_BYTES], src[2 * VRAM_ROW_BYTES],
+                                                src[1 * VRAM_ROW_BYTES], src[0]);
+
+            for (int bit = 0; bit < 8; bit++)
+            {
+                const int y = SCREEN_HEIGHT - 1 - (c * 8 + bit);
+                const __m128i mask = _mm_set1_epi32(1 << bit);
+                const __m128i lit = _mm_cmpeq_epi32(_mm_and_si128(bytes, mask), mask);
+                const __m128i colour = _mm_set1_epi32(overlay ? overlay[y * COLUMN_GROUPS + r / 8] : WHITE);
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + y * stride + r - first_row),
+                                 _mm_and_si128(lit, colour));
+            }
+        }
+}
+#else
+static void expand_scalar(const u8* vram, u32* pixels, int stride, int first_row, int end_row, const u32* overlay)
+{
+    for (int c = 0; c < VRAM_ROW_BYTES; c++)
+        for (int r = first_row; r < end_row; r++)
+        {
+            const u8 byte = vram[r * VRAM_ROW_BYTES + c];
+
+            for (int bit = 0; bit < 8; bit++)
+            {
+                const int y = SCREEN_HEIGHT - 1 - (c * 8 + bit);
+                const u32 colour = overlay ? overlay[y * COLUMN_GROUPS + r / 8] : WHITE;
+
+                pixels[y * stride + r - first_row] = (byte >> bit) & 0x01 ? colour : 0;
+            }
+        }
+}
+#endif
+
+void expand_vram(const u8* vram, u32* pixels, int stride, int first_row, int end_row, bool overlay)
+{
+    const u32* colours = overlay ? OVERLAY.data() : nullptr;
+
+#if SCREEN_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        expand_avx2(vram, pixels, stride, first_row, end_row, colours);
+        return;
+    }
+#endif
+
+#if defined(__SSE2__)
+    expand_sse2(vram, pixels, stride, first_row, end_row, colours);
+#else
+    expand_scalar(vram, pixels, stride, first_row, end_row, colours);
+#endif
+}
+
+void expand_vram_mono(const u8* vram, u8* pixels)
+{
+    for (int y = 0; y < SCREEN_HEIGHT; y++)
+    {
+        const int x = SCREEN_HEIGHT - 1 - y; // pixel within each VRAM row
+        const u8* src = vram + x / 8;
+        u8* out = pixels + y * SCREEN_WIDTH;
+
+        for (int r = 0; r < VRAM_ROWS; r++)
+            out[r] = -((src[r * VRAM_ROW_BYTES] >> (x % 8)) & 0x01);
+    }
+}
+
+void Screen::update(const Frame& frame, bool overlay)
+{
+    strip_count = 0;
+    int offset = 0;
+
+    for (int group = 0; group < VRAM_ROWS / 8; )
+    {
+        auto dirty = [&frame](int group) {
+            return (frame.dirty[group / 8] >> (group % 8 * 8)) & 0xFF;
+        };
+
+        if (!dirty(group)) {
+            group++;
+            continue;
+        }
+
+        int end = group + 1;
+        while (end < VRAM_ROWS / 8 && dirty(end))
+            end++;
+
+        const int width = (end - group) * 8;
+        expand_vram(frame.vram.data(), pixels.data() + offset, width, group * 8, end * 8, overlay);
+        strips[strip_count++] = {group * 8, width, pixels.data() + offset};
+        offset += width * SCREEN_HEIGHT;
+        group = end;
+    }
+}
+
+int Screen::get_strip_count() const
+{
+    return strip_count;
+}
+
+const Screen::Strip& Screen::get_strip(int index) const
+{
+    return strips[index];
+}
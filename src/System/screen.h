@@ -0,0 +1,59 @@
+#pragma once
+#include <array>
+#include "../8080/types.h"
+
+// VRAM holds 224 rows of 256 one-bit pixels, least significant bit first.
+// The monitor is mounted rotated 90 degrees counter-clockwise, so the screen
+// is 224 pixels wide and 256 high: VRAM row r becomes screen column r, and
+// pixel x of that row lands on screen row 255 - x.
+static constexpr int VRAM_ROWS = 224;
+static constexpr int VRAM_ROW_BYTES = 32;
+static constexpr int SCREEN_WIDTH = VRAM_ROWS;
+static constexpr int SCREEN_HEIGHT = VRAM_ROW_BYTES * 8;
+
+// Expands VRAM rows [first_row, end_row) into the screen columns they show,
+// as RGBA pixels (one u32 each, in R G B A byte order). pixels receives the
+// top left pixel of column first_row and stride is the width of its rows,
+// so the strip can go into a full frame or a buffer of its own. Both bounds
+// must be multiples of 8. Unlit pixels are transparent black; lit ones are
+// white, or with overlay the colour of the cabinet's gel strip in front of
+// them. Uses AVX2 or SSE2 when the CPU has them.
+void expand_vram(const u8* vram, u32* pixels, int stride, int first_row, int end_row, bool overlay);
+
+// The whole screen at one byte per pixel, 0 or 0xFF, SCREEN_HEIGHT rows of
+// SCREEN_WIDTH from the top left
+void expand_vram_mono(const u8* vram, u8* pixels);
+
+// VRAM rows changed since some earlier point, one bit each
+using DirtyRows = std::array<u64, (VRAM_ROWS + 63) / 64>;
+
+// A finished frame as handed from emulation to presentation: VRAM
+// (0x2400-0x3FFF) at the end of the frame, and the rows written since the
+// last frame that was presented
+struct Frame {
+    std::array<u8, VRAM_ROWS * VRAM_ROW_BYTES> vram;
+    DirtyRows dirty;
+};
+
+// Screen pixels kept in step with a series of frames. Only the columns of
+// dirty rows are re-expanded, in groups of 8 rows, and packed as one
+// full-height strip per run of dirty groups so each can be uploaded on its
+// own. Most frames only touch a few rows.
+class Screen
+{
+    public:
+    struct Strip {
+        int x;
+        int width;
+        const u32* pixels;
+    };
+
+    void update(const Frame& frame, bool overlay);
+    int get_strip_count() const;
+    const Strip& get_strip(int index) const;
+
+    private:
+    std::array<u32, SCREEN_WIDTH * SCREEN_HEIGHT> pixels = {}; // RGBA
+    std::array<Strip, VRAM_ROWS / 8> strips = {};
+    int strip_count = 0;
+};
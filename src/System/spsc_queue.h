@@ -0,0 +1,42 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Fixed ring of up to Size - 1 items from one producer thread to one
+// consumer thread. Neither side ever blocks or allocates; push() fails when
+// the ring is full.
+template <typename T, size_t Size>
+class SpscQueue
+{
+    static_assert(Size && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+    public:
+    bool push(const T& item)
+    {
+        const size_t tail = write.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) & (Size - 1);
+        if (next == read.load(std::memory_order_acquire))
+            return false;
+
+        items[tail] = item;
+        write.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        const size_t head = read.load(std::memory_order_relaxed);
+        if (head == write.load(std::memory_order_acquire))
+            return false;
+
+        item = items[head];
+        read.store((head + 1) & (Size - 1), std::memory_order_release);
+        return true;
+    }
+
+    private:
+    std::array<T, Size> items = {};
+    alignas(64) std::atomic<size_t> read{0};  // next item to pop
+    alignas(64) std::atomic<size_t> write{0}; // next free slot
+};
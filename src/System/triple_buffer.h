@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include "../8080/types.h"
+
+// Hands the newest of a stream of values from one producer thread to one
+// consumer thread without locks or waiting. Each side owns one of three
+// slots and the third holds the latest published value; publishing and
+// taking swap slots with a single atomic exchange. A value the consumer was
+// too slow to take is replaced by the next one.
+template <typename T>
+class TripleBuffer
+{
+    public:
+    // Slot the producer fills before publish()
+    T& back()
+    {
+        return slots[back_index];
+    }
+
+    // Makes back() the newest value and hands the producer another slot.
+    // Returns true if the value published before this one was never taken;
+    // that slot is the new back() and still holds it.
+    bool publish()
+    {
+        const u8 previous = middle.exchange(back_index | FRESH, std::memory_order_acq_rel);
+        back_index = previous & INDEX;
+        return previous & FRESH;
+    }
+
+    // Newest value, or null if nothing was published since the last call
+    const T* take()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return nullptr;
+
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX;
+        return &slots[front_index];
+    }
+
+    private:
+    static constexpr u8 INDEX = 0x03;
+    static constexpr u8 FRESH = 0x04;
+
+    std::array<T, 3> slots = {};
+    alignas(64) std::atomic<u8> middle{1};
+    alignas(64) u8 back_index = 0;  // producer only
+    alignas(64) u8 front_index = 2; // consumer only
+};
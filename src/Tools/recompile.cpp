@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <vector>
+#include "../8080/opcodes.h"
+
+// Static recompiler: walks the ROM code reachable from the reset and
+// interrupt vectors and writes recompiled.inc, which spaceinvaders-aot
+// compiles into Cpu. Every block becomes a function calling the opcode bodies
+// with constant opcodes and operands, so the compiler flattens it into
+// straight-line code. The blocks are cut exactly where CodeCache::build()
+// cuts them, so they are charged the same cycles. Anything not found here
+// (PCHL targets, code in RAM, return addresses of interrupted blocks) is
+// still run by the interpreter.
+
+static constexpr int ROM_SIZE = 0x2000; // as padded by Invaders::load_rom()
+
+struct Instruction {
+    u8 opcode;
+    u16 operand;
+    u16 next_pc;
+};
+
+static std::vector<Instruction> decode_block(const std::vector<u8>& rom, int addr)
+{
+    std::vector<Instruction> block;
+
+    while (addr < ROM_SIZE && block.size() < MAX_BLOCK_LENGTH)
+    {
+        const u8 opcode = rom[addr];
+        const int next = addr + LENGTH_TABLE[opcode];
+        if (next > ROM_SIZE)
+            break;
+
+        u16 operand = 0;
+        if (LENGTH_TABLE[opcode] > 1)
+            operand = rom[addr + 1];
+        if (LENGTH_TABLE[opcode] > 2)
+            operand |= rom[addr + 2] << 8;
+
+        block.push_back({opcode, operand, static_cast<u16>(next)});
+        addr = next;
+
+        if (ends_block(opcode))
+            break;
+    }
+
+    return block;
+}
+
+// Addresses execution can continue at after the last instruction of a block
+static std::vector<int> successors(const Instruction& last)
+{
+    const u8 opcode = last.opcode;
+    const int next = last.next_pc;
+
+    if (!ends_block(opcode))
+        return {next};
+
+    switch (opcode)
+    {
+        case 0x76:                                  // HLT stays on itself
+            return {next - 1};
+        case 0xE9:                                  // PCHL
+        case 0xC9: case 0xD9:                       // RET
+            return {};
+        case 0xC3: case 0xCB:                       // JMP
+            return {last.operand};
+        case 0xCD: case 0xDD: case 0xED: case 0xFD: // CALL
+            return {last.operand, next};
+        default:
+            break;
+    }
+
+    switch (opcode & 0x07)
+    {
+        case 0x00:                                  // Rcc
+            return {next};
+        case 0x07:                                  // RST returns 2 bytes on
+            return {opcode & 0x38, next + 2};
+        default:                                    // Jcc, Ccc
+            return {last.operand, next};
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        printf("usage: %s <rom> <recompiled.inc>\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file) {
+        printf("cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    file.unsetf(std::ios::skipws);
+    std::vector<u8> rom;
+    std::copy(std::istream_iterator<u8>(file), std::istream_iterator<u8>(),
+            std::back_inserter(rom));
+    rom.resize(ROM_SIZE, 0xFF);
+
+    // reset, RST 1 and RST 2
+    std::vector<int> pending = {0x0000, 0x0008, 0x0010};
+    std::set<int> starts;
+
+    while (!pending.empty())
+    {
+        const int addr = pending.back();
+        pending.pop_back();
+
+        if (addr >= ROM_SIZE || !starts.insert(addr).second)
+            continue;
+
+        const std::vector<Instruction> block = decode_block(rom, addr);
+        if (block.empty()) {
+            starts.erase(addr);
+            continue;
+        }
+
+        for (int next : successors(block.back()))
+            pending.push_back(next);
+    }
+
+    FILE* out = fopen(argv[2], "w");
+    if (!out) {
+        printf("cannot write %s\n", argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by invaders-recompile from %s, do not edit.\n", argv[1]);
+    fprintf(out, "// %zu blocks reachable from the reset and interrupt vectors.\n\n", starts.size());
+    fprintf(out, "template <typename Bus>\nstruct Recompiled\n{\n");
+
+    fprintf(out, "    static constexpr u16 ROM_SIZE = 0x%04X;\n", ROM_SIZE);
+    fprintf(out, "    static constexpr u8 ROM[ROM_SIZE] = {");
+    for (int i = 0; i < ROM_SIZE; i++)
+        fprintf(out, "%s0x%02X,", i % 16 ? " " : "\n        ", rom[i]);
+    fprintf(out, "\n    };\n\n");
+
+    fprintf(out, "    static bool matches(const Cpu<Bus>& cpu)\n    {\n");
+    fprintf(out, "        if (cpu.cache_end != ROM_SIZE)\n            return false;\n\n");
+    fprintf(out, "        for (int i = 0; i < ROM_SIZE; i++)\n");
+    fprintf(out, "            if (cpu.read_byte(i) != ROM[i])\n                return false;\n\n");
+    fprintf(out, "        return true;\n    }\n");
+
+    for (int addr : starts)
+    {
+        const std::vector<Instruction> block = decode_block(rom, addr);
+
+        fprintf(out, "\n    static void block_%04X(Cpu<Bus>* cpu)\n    {\n", addr);
+        for (size_t i = 0; i < block.size(); i++)
+        {
+            // only the last instruction can read pc
+            if (i == block.size() - 1)
+                fprintf(out, "        cpu->pc = 0x%04X;\n", block[i].next_pc);
+            fprintf(out, "        cpu->execute(0x%02X, 0x%04X);\n", block[i].opcode, block[i].operand);
+        }
+        fprintf(out, "    }\n");
+    }
+
+    fprintf(out, "\n    static void (*find(u16 addr))(Cpu<Bus>*)\n    {\n");
+    fprintf(out, "        switch (addr)\n        {\n");
+    for (int addr : starts)
+        fprintf(out, "            case 0x%04X: return &block_%04X;\n", addr, addr);
+    fprintf(out, "            default: return nullptr;\n        }\n    }\n};\n");
+
+    fclose(out);
+    printf("%zu blocks\n", starts.size());
+    return 0;
+}